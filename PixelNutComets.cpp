@@ -34,15 +34,116 @@ typedef struct ATTR_PACKED
 CometHead;        // defines a head for the comet effect
 C_ASSERT(sizeof(CometHead) == 8);
 
+// Heads are kept in a ring in the order they were added, which is also the order of their
+// positions, since every head starts at position 0 and all of them advance together: the
+// front of the ring is the head furthest along, the back is the one most recently added.
+// Heads that finish are left in place as retired entries, and removed once they reach the
+// front or back of the ring, or when the ring is compacted because it has filled up.
+
 typedef struct ATTR_PACKED
 {
-  byte count;                   // number of heads that are supported
-  byte inuse;                   // number of heads currently in use
-  uint16_t filler;
+  uint16_t count;               // number of heads that are supported
+  uint16_t inuse;               // number of heads currently in use
+  uint16_t first;               // index of the front of the ring
+  uint16_t used;                // number of entries in the ring, including retired heads
+  uint16_t fadelen, fadepos;    // length of fade and starting position the factors were made for
+  byte bright, maxbright;       // brightness values the factors were made for
+  byte *pfactors;               // brightness factors down the tail (NULL until first drawn)
   CometHead heads[0];           // internally allocated head data starts here
 }
 CometHeadData;   // defines data for list of heads for the comet effect
-C_ASSERT(sizeof(CometHeadData) == 4);
+C_ASSERT(sizeof(CometHeadData) == (14 + sizeof(byte*)));
+
+#define HEAD_RETIRED(phead) (!(phead)->dowrap && (phead)->offend)
+
+// returns the entry at the index from the front of the ring
+static CometHead *RingHead(CometHeadData *pData, uint16_t index)
+{
+  uint16_t i = pData->first + index;
+  if (i >= pData->count) i -= pData->count;
+  return &pData->heads[i];
+}
+
+// removes all retired heads from the ring, keeping the rest in the same order
+static void CompactHeads(CometHeadData *pData)
+{
+  uint16_t n = 0;
+  for (uint16_t i = 0; i < pData->used; ++i)
+  {
+    CometHead *phead = RingHead(pData, i);
+    if (HEAD_RETIRED(phead)) continue;
+    if (n != i) *RingHead(pData, n) = *phead;
+    ++n;
+  }
+  pData->used = n;
+}
+
+// moves head that has just wrapped around to the back of the ring, since it's now at the start
+static void WrapHead(CometHeadData *pData, uint16_t index)
+{
+  CometHead head = *RingHead(pData, index);
+
+  if (index == 0) // at the front: just remove it
+  {
+    if (++pData->first >= pData->count) pData->first = 0;
+    --pData->used;
+  }
+  else
+  {
+    RingHead(pData, index)->dowrap = false; // leave retired head in its place
+    if (pData->used >= pData->count) CompactHeads(pData);
+  }
+
+  *RingHead(pData, pData->used++) = head;
+}
+
+// returns the brightness factors for each pixel of the tail, from 'fadepos' pixels down from the
+// head fading to black, which are only recalculated when the fade or the brightness changes: the
+// brightness is stepped down exactly as when each pixel was set with its own scale, so that the
+// pixels are the same (only heads that have fallen off the end start in the middle of the fade)
+static byte *FadeFactors(CometHeadData *pData, PixelNutHandle handle, byte bright,
+                         uint16_t fadelen, uint16_t fadepos, uint16_t pixlen)
+{
+  byte maxbright = ((PixelNutEngine*)handle)->getMaxBrightness();
+
+  if (pData->pfactors == NULL)
+  {
+    // enough for the longest tail possible
+    pData->pfactors = (byte*)malloc(pixlen+1);
+    if (pData->pfactors == NULL)
+    {
+      DBGOUT((F("Cannot allocate %d bytes for comet tail"), pixlen+1));
+      return NULL;
+    }
+  }
+  else if ((pData->fadelen == fadelen) && (pData->fadepos == fadepos) &&
+           (pData->bright == bright) && (pData->maxbright == maxbright))
+    return pData->pfactors;
+
+  float fade_scale = ((float)bright / MAX_PERCENTAGE);
+  float fade_step = (fadelen ? (fade_scale / fadelen) : fade_scale);
+
+  if (fadepos > 0) // starting in middle of the fade
+  {
+    fade_scale -= (fadepos * fade_step);
+    if (fade_scale < 0) fade_scale = 0;
+  }
+
+  byte *pf = pData->pfactors;
+  for (int i = fadepos; i <= fadelen; ++i)
+  {
+    *pf++ = pixelNutSupport.makeBrightFactor(handle, fade_scale);
+    fade_scale -= fade_step;
+    if (fade_scale < 0) fade_scale = 0;
+  }
+  memset(pf, 0, ((pData->pfactors + pixlen + 1) - pf)); // rest of tail is dark
+
+  pData->fadelen = fadelen;
+  pData->fadepos = fadepos;
+  pData->bright = bright;
+  pData->maxbright = maxbright;
+  return pData->pfactors;
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -64,133 +165,143 @@ PixelNutComets::cometData PixelNutComets::cometHeadCreate(uint16_t headcount)
   CometHeadData *pData = (CometHeadData*)memptr;
   pData->count = headcount;
   pData->inuse = 0;
-
-  CometHead *phead = pData->heads;
-  for (int i = 0; i < headcount; ++i, ++phead)
-  {
-    // clear to unused status
-    phead->dowrap = false;
-    phead->offend = true;
-  }
+  pData->first = 0;
+  pData->used = 0;
+  pData->pfactors = NULL;
 
   DBGOUT((F("Allocated %d bytes for %d comet heads"), memlen, headcount));
   return (PixelNutComets::cometData)pData;
 }
 
+// includes the fade factors allocated once drawn
+uint16_t PixelNutComets::cometHeadBytes(uint16_t headcount, uint16_t pixlen)
+{
+  return (sizeof(CometHeadData) + (headcount * sizeof(CometHead)) + (pixlen+1));
+}
+
+uint16_t PixelNutComets::cometHeadCount(PixelNutComets::cometData cdata)
+{
+  return ((cdata != NULL) ? ((CometHeadData*)cdata)->count : 0);
+}
+
 void PixelNutComets::cometHeadDelete(PixelNutComets::cometData cdata)
 {
   CometHeadData *pData = (CometHeadData*)cdata;
   if (pData != NULL)
   {
     DBGOUT((F("Freed data for %d comet heads: %d in use"), pData->count, pData->inuse));
+    if (pData->pfactors != NULL) free(pData->pfactors);
     free(pData);
   }
 }
 
-// adds new head or overwrites existing one if no more room, returns number of heads currently in use
-int PixelNutComets::cometHeadAdd(PixelNutComets::cometData cdata, byte layer, bool dowrap, uint16_t pixlen)
-{
-  if (cdata == NULL) return 0;
+// the saved state is the ring counts followed by the heads: the fade factors are recreated when drawn
+#define SAVED_HEADER_LEN (4 * sizeof(uint16_t))
 
+uint16_t PixelNutComets::cometHeadSave(PixelNutComets::cometData cdata, byte *pbuff)
+{
   CometHeadData *pData = (CometHeadData*)cdata;
-  CometHead *phead = pData->heads;
-  int maxheads = pData->count;
+  if (pData == NULL) return 0;
 
-  #if DEBUG_OUTPUT
-  DBGOUT((F("AddHead: Layer=%d Count=%d/%d"), layer, pData->inuse, maxheads));
-  DBGOUT((F("  Before:")));
-  for (int i = 0; i < maxheads; ++i)
+  uint16_t headlen = (pData->count * sizeof(CometHead));
+  if (pbuff != NULL)
   {
-    if (phead[i].dowrap || !phead[i].offend)
-         DBGOUT((F("  #%d: DoWrap=%d OffEnd=%d CurPos=%-3d MaxLen=%-3d"), i,
-                phead[i].dowrap, phead[i].offend, phead[i].curpos, phead[i].maxlen));
-    //else DBGOUT((F("  #%d: unused"), i));
+    memcpy(pbuff, &pData->count, sizeof(uint16_t));
+    memcpy(pbuff+2, &pData->inuse, sizeof(uint16_t));
+    memcpy(pbuff+4, &pData->first, sizeof(uint16_t));
+    memcpy(pbuff+6, &pData->used, sizeof(uint16_t));
+    memcpy((pbuff + SAVED_HEADER_LEN), pData->heads, headlen);
   }
-  #endif
-
-  // find empty slot or one with minimum position:
+  return (SAVED_HEADER_LEN + headlen);
+}
 
-  int index = 0;
-  int minpos = pixlen;
-  bool doinsert = false;
+PixelNutComets::cometData PixelNutComets::cometHeadLoad(const byte *pbuff, uint16_t len)
+{
+  uint16_t count = 0, inuse = 0, first = 0, used = 0;
+  if (len >= SAVED_HEADER_LEN)
+  {
+    memcpy(&count, pbuff, sizeof(uint16_t));
+    memcpy(&inuse, pbuff+2, sizeof(uint16_t));
+    memcpy(&first, pbuff+4, sizeof(uint16_t));
+    memcpy(&used,  pbuff+6, sizeof(uint16_t));
+  }
 
-  for (int i = 0; i < maxheads; ++i)
+  if ((len < SAVED_HEADER_LEN) || (len != (SAVED_HEADER_LEN + (count * sizeof(CometHead)))) ||
+      (used > count) || (inuse > used) || (count && (first >= count)))
   {
-    if (!phead[i].dowrap && phead[i].offend) // unused slot
-    {
-      doinsert = true;
-      ++pData->inuse;
-      index = i;
-      break;
-    }
+    DBGOUT((F("Invalid saved data for comet heads: len=%d"), len));
+    return NULL;
+  }
 
-    if (phead[i].curpos == 0) // already have head at starting position
-      return pData->inuse;
+  CometHeadData *pData = (CometHeadData*)cometHeadCreate(count);
+  if (pData == NULL) return NULL;
 
-    if (minpos > phead[i].curpos)
-    {
-      minpos = phead[i].curpos;
-      index = i;
-    }
-  }
+  pData->inuse = inuse;
+  pData->first = first;
+  pData->used = used;
+  memcpy(pData->heads, (pbuff + SAVED_HEADER_LEN), (count * sizeof(CometHead)));
+
+  DBGOUT((F("Restored %d comet heads: %d in use"), count, inuse));
+  return (PixelNutComets::cometData)pData;
+}
 
-  // return if no empty slots
-  if (!doinsert) return pData->inuse;
+// adds new head at the start if there's room, returns number of heads currently in use
+int PixelNutComets::cometHeadAdd(PixelNutComets::cometData cdata, byte layer, bool dowrap, uint16_t pixlen)
+{
+  if (cdata == NULL) return 0;
 
-  // now find the minimum position excluding one just chosen:
+  CometHeadData *pData = (CometHeadData*)cdata;
 
-  int next_index = -1;
-  int maxlen = pixlen;
-  minpos = pixlen;
+  #if DEBUG_OUTPUT
+  DBGOUT((F("AddHead: Layer=%d Count=%d/%d Ring=%d+%d"), layer, pData->inuse, pData->count, pData->first, pData->used));
+  #endif
+
+  // remove retired heads from the back of the ring
+  while (pData->used && HEAD_RETIRED(RingHead(pData, pData->used-1)))
+    --pData->used;
 
-  for (int i = 0; i < maxheads; ++i)
+  if (pData->used >= pData->count)
   {
-    if (i == index) continue; // skip new one
+    CompactHeads(pData);
 
-    if (phead[i].dowrap || !phead[i].offend) // is in use
-    {
-      if (minpos > phead[i].curpos)
-      {
-        minpos = phead[i].curpos;
-        next_index = i;
-      }
-    }
+    // return if no empty slots
+    if (pData->used >= pData->count) return pData->inuse;
   }
 
-  // if there's a head in front of this new one,
-  // adjust its length and set maxlen for new one:
+  // the head in front of this new one is the last one added
+  CometHead *pnext = (pData->used ? RingHead(pData, pData->used-1) : NULL);
+  int maxlen = pixlen;
 
-  if (next_index >= 0)
+  if (pnext != NULL)
   {
-    if (!dowrap)
-         maxlen = pixlen; // until new head comes after
-    else if (doinsert)
-         maxlen = (phead[next_index].maxlen - phead[next_index].curpos);
-    else maxlen = (phead[index].maxlen - phead[index].curpos);
-
-    // next head's length is exactly it's current position since new one starts at 0
-    phead[next_index].maxlen = phead[next_index].curpos;
+    if (pnext->curpos == 0) // already have head at starting position
+      return pData->inuse;
+
+    // if that head is still on the strip,
+    // adjust its length and set maxlen for new one:
+
+    if (pnext->curpos < pixlen)
+    {
+      if (dowrap) maxlen = (pnext->maxlen - pnext->curpos);
+      // else until new head comes after
+
+      // next head's length is exactly it's current position since new one starts at 0
+      pnext->maxlen = pnext->curpos;
+    }
   }
 
-  phead[index].dowrap  = dowrap;    // true to allow wrapping
-  phead[index].offend  = false;     // true once went off end or wrapped
-  phead[index].curpos  = 0;         // always starts at 0
-  phead[index].maxlen  = maxlen;    // distance to the next head
-  phead[index].prevlen = 0;         // no previous length yet
+  CometHead *phead = RingHead(pData, pData->used++);
+  phead->dowrap  = dowrap;    // true to allow wrapping
+  phead->offend  = false;     // true once went off end or wrapped
+  phead->curpos  = 0;         // always starts at 0
+  phead->maxlen  = maxlen;    // distance to the next head
+  phead->prevlen = 0;         // no previous length yet
 
   #if DEBUG_OUTPUT
-  DBGOUT((F("  After:")));
-  for (int i = 0; i < maxheads; ++i)
-  {
-    if (phead[i].dowrap || !phead[i].offend)
-         DBGOUT((F("  #%d: DoWrap=%d OffEnd=%d CurPos=%-3d MaxLen=%-3d%s"), i,
-                phead[i].dowrap, phead[i].offend, phead[i].curpos, phead[i].maxlen,
-                ((i == index) ? "<==" : "")));
-    //else DBGOUT((F("  #%d: unused"), i));
-  }
+  DBGOUT((F("  Added: DoWrap=%d MaxLen=%-3d"), dowrap, maxlen));
   #endif
 
-  return pData->inuse;
+  return ++pData->inuse;
 }
 
 // draws all valid comet heads, returns number of heads currently in use
@@ -201,11 +312,20 @@ int PixelNutComets::cometHeadDraw(PixelNutComets::cometData cdata, byte layer,
   if (cdata == NULL) return 0;
 
   CometHeadData *pData = (CometHeadData*)cdata;
-  CometHead *phead = pData->heads;
 
-  for (int headnum = 0; headnum < pData->count; ++headnum, ++phead)
+  // remove retired heads from the front of the ring
+  while (pData->used && HEAD_RETIRED(RingHead(pData, 0)))
+  {
+    if (++pData->first >= pData->count) pData->first = 0;
+    --pData->used;
+  }
+
+  int wrapnum = -1; // only one head can reach the end in each step
+
+  for (uint16_t headnum = 0; headnum < pData->used; ++headnum)
   {
-    if (!phead->dowrap && phead->offend) // don't draw this head
+    CometHead *phead = RingHead(pData, headnum);
+    if (HEAD_RETIRED(phead)) // don't draw this head
       continue;
 
     #if 0 //DEBUG_OUTPUT
@@ -238,50 +358,30 @@ int PixelNutComets::cometHeadDraw(PixelNutComets::cometData cdata, byte layer,
           bodylen = (headpos + 1); // grow body each time
     }
   
-    // establish max brightness and fade to black along tail
-    float fade_scale = ((float)pdraw->pcentBright / MAX_PERCENTAGE);
-    float fade_step = (fade_scale / fadelen);
-  
     int curpos = headpos;
     int drawlen = bodylen; // drawing entire body, unless...
+    int fadepos = 0;       // starting at the head of the fade
 
     if (headpos >= pixlen) // fallen off end
     {
       // adjust for pixels already off end
-      int adjustpos = (headpos - pixlen);
-
-      drawlen -= adjustpos;
-      if (drawlen > 0)
-      {
-        // starting in middle of the fade
-        fade_scale -= (adjustpos * fade_step);
-        if (fade_scale < 0) fade_scale = 0;
-      }
-  
+      fadepos = (headpos - pixlen);
+      drawlen -= fadepos;
       curpos = pixlen-1; // start at ending pixel
     }
   
     #if 0 //DEBUG_OUTPUT
     DBGOUT((F("L%d %2d: %sHeadPos=%-3d CurPos=%-3d StartBody=%-3d CurBody=%-3d DrawLen=%-3d FadeLen=%d"),
         layer, headnum, (phead->offend ? " " : "^"), headpos, curpos, startbodylen, bodylen, drawlen, fadelen));
-    //DBGOUT((F("    Fade(Scale=%-3d%% Step=%-3d%% Len=%d)"), (int)(fade_scale*100), (int)(fade_step*100), fadelen));
     #endif
   
     if (drawlen > 0)
     {
-      while(1)
-      {
-        //DBGOUT((F("  %3d: DrawLen=%3d Scale=%3d%%"), curpos, drawlen, (int)(fade_scale*100)));
-  
-        pixelNutSupport.setPixel(handle, curpos, pdraw->r, pdraw->g, pdraw->b, fade_scale);
-  
-        if (!--drawlen) break;
-
-        if (--curpos < 0) curpos = pixlen-1;
-  
-        fade_scale -= fade_step;
-        if (fade_scale < 0) fade_scale = 0;
-      }
+      // establish max brightness and fade to black along tail
+      byte *pfactors = FadeFactors(pData, handle, pdraw->pcentBright, fadelen, fadepos, pixlen);
+      if (pfactors != NULL)
+        pixelNutSupport.setPixelRamp(handle, curpos, drawlen, pixlen,
+                                     pdraw->r, pdraw->g, pdraw->b, pfactors);
 
       phead->curpos = ++headpos;
     }
@@ -293,6 +393,7 @@ int PixelNutComets::cometHeadDraw(PixelNutComets::cometData cdata, byte layer,
       {
         phead->curpos = 0;
         phead->offend = true;
+        wrapnum = headnum;
       }
     }
     else // if not wrapping check if body is completely done
@@ -306,5 +407,7 @@ int PixelNutComets::cometHeadDraw(PixelNutComets::cometData cdata, byte layer,
     }
   }
 
+  if (wrapnum >= 0) WrapHead(pData, wrapnum);
+
   return pData->inuse;
 }
@@ -9,6 +9,8 @@
 
 extern PluginFactory *pPluginFactory; // use externally declared pointer to instance
 
+#define MAX_CATCHUP_STEPS 4 // max steps a track is advanced per frame when catching up
+
 #define DEBUG_OUTPUT 0 // 1 to debug this file
 #if DEBUG_OUTPUT
 #define DBG(x) x
@@ -25,6 +27,18 @@ extern PluginFactory *pPluginFactory; // use externally declared pointer to inst
 PixelNutEngine::PixelNutEngine(byte *ptr_pixels, uint16_t num_pixels,
                                uint16_t first_pixel, bool goupwards,
                                short num_layers, short num_tracks)
+{
+  Init(ptr_pixels, num_pixels, first_pixel, goupwards, num_layers, num_tracks, NULL);
+}
+
+PixelNutEngine::PixelNutEngine(byte *ptr_pixels, uint16_t num_pixels, uint16_t first_pixel, bool goupwards,
+                               short num_layers, short num_tracks, byte *pmemory)
+{
+  Init(ptr_pixels, num_pixels, first_pixel, goupwards, num_layers, num_tracks, pmemory);
+}
+
+void PixelNutEngine::Init(byte *ptr_pixels, uint16_t num_pixels, uint16_t first_pixel, bool goupwards,
+                          short num_layers, short num_tracks, byte *pmemory)
 {
   // NOTE: cannot call DBGOUT here if statically constructed
 
@@ -38,13 +52,33 @@ PixelNutEngine::PixelNutEngine(byte *ptr_pixels, uint16_t num_pixels,
   maxPluginLayers = num_layers;
   maxPluginTracks = num_tracks;
 
-  pluginLayers = (PluginLayer*)malloc(num_layers * sizeof(PluginLayer));
-  pluginTracks = (PluginTrack*)malloc(num_tracks * sizeof(PluginTrack));
+  if (pmemory != NULL) // laid out in the same order as counted by 'StaticBytes()'
+  {
+    pluginLayers = (PluginLayer*)pmemory;
+    pluginTracks = (PluginTrack*)(pmemory + (num_layers * sizeof(PluginLayer)));
+    routeIndex   = (byte*)(pluginTracks + num_tracks);
+    routeLayers  = routeIndex + (num_layers+1);
+    pStaticBuffs = routeLayers + num_layers; // buffer for each track at a fixed place
+  }
+  else
+  {
+    pluginLayers = (PluginLayer*)malloc(num_layers * sizeof(PluginLayer));
+    pluginTracks = (PluginTrack*)malloc(num_tracks * sizeof(PluginTrack));
+
+    routeIndex  = (byte*)malloc(num_layers+1);
+    routeLayers = (byte*)malloc(num_layers);
+  }
+  if (routeIndex != NULL) memset(routeIndex, 0, num_layers+1);
 
   if ((ptr_pixels == NULL) || (num_pixels == 0) ||
-    (pluginLayers == NULL) || (pluginTracks == NULL))
+    (pluginLayers == NULL) || (pluginTracks == NULL) ||
+    (routeIndex == NULL) || (routeLayers == NULL))
        pDrawPixels = NULL; // caller must test for this
   else pDrawPixels = pDisplayPixels;
+
+  drawOffset = 0;
+  drawLength = 0; // display buffer cannot be scrolled
+  drawPixBytes = 3;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -121,7 +155,7 @@ void PixelNutEngine::popPluginStack(int count)
       if (pluginTracks[indexTrackStack].pRedrawBuff != NULL)
       {
         DBGOUT((F("Freeing pixel buffer: track=%d"), indexTrackStack));
-        free(pluginTracks[indexTrackStack].pRedrawBuff);
+        FreeTrackBuff(pluginTracks[indexTrackStack].pRedrawBuff);
       }
 
       if (indexTrackEnable >= indexTrackStack)
@@ -130,7 +164,7 @@ void PixelNutEngine::popPluginStack(int count)
       --indexTrackStack;
     }
 
-    delete pluginLayers[indexLayerStack].pPlugin;
+    FreePlugin(pluginLayers[indexLayerStack].pPlugin);
     --indexLayerStack; // pop off a layer
   }
 
@@ -144,34 +178,42 @@ void PixelNutEngine::popPluginStack(int count)
   }
 }
 */
-void PixelNutEngine::clearStack(void)
+// internal: delete all layer plugins and free all track buffers, leaving the stacks empty
+void PixelNutEngine::FreeStack(void)
 {
-  DBGOUT((F("Clear stack: layer=%d track=%d"), indexLayerStack, indexTrackStack));
+  for (int i = indexLayerStack; i >= 0; --i)
+    FreePlugin(pluginLayers[i].pPlugin);
 
   for (int i = indexTrackStack; i >= 0; --i)
   {
-    DBGOUT((F("  Layer %d: track=%d"), i, pluginLayers[i].track));
-
-    // delete in reverse order: first the layer plugins
-    int count = 0;
-    for (int j = pluginTracks[i].layer; j < indexLayerStack; ++j)
-    {
-      ++count;
-      delete pluginLayers[j].pPlugin;
-    }
-    indexLayerStack -= count;
-
-    // then the track buffer
     if (pluginTracks[i].pRedrawBuff != NULL)
     {
-      DBGOUT((F("Freeing pixel buffer: track=%d"), indexTrackStack));
-      free(pluginTracks[i].pRedrawBuff);
+      DBGOUT((F("Freeing pixel buffer: track=%d"), i));
+      FreeTrackBuff(pluginTracks[i].pRedrawBuff);
     }
   }
 
-  indexTrackEnable = 0;
-  indexLayerStack = 0;
-  indexLayerStack = 0;
+  indexLayerStack  = -1;
+  indexTrackStack  = -1;
+  indexTrackEnable = -1;
+  trigQueueCount = 0; // nothing left to trigger
+  BuildRoutes();
+
+  if (patternSlots != NULL) // no longer holds a cached pattern
+  {
+    patternSlots[activePatternSlot].patternId = MAX_WORD_VALUE;
+    patternSlots[activePatternSlot].memBytes = 0;
+  }
+
+  UpdateMemory();
+}
+
+void PixelNutEngine::clearStack(void)
+{
+  StopLoop();
+  DBGOUT((F("Clear stack: layer=%d track=%d"), indexLayerStack, indexTrackStack));
+
+  FreeStack();
 
   segOffset = 0; // reset the segment limits
   segCount = numPixels;
@@ -180,6 +222,37 @@ void PixelNutEngine::clearStack(void)
   memset(pDisplayPixels, 0, (numPixels*3));
 }
 
+// internal: returns the factory set for this engine, or else the application's
+PixelNutFactory *PixelNutEngine::Factory(void)
+{
+  if (pFactory != NULL) return pFactory;
+  return pPluginFactory;
+}
+
+PixelNutPlugin *PixelNutEngine::MakePlugin(int plugin)
+{
+  return Factory()->makePlugin(plugin);
+}
+
+// internal: deletes a plugin with the same factory that created it
+void PixelNutEngine::FreePlugin(PixelNutPlugin *pPlugin)
+{
+  Factory()->freePlugin(pPlugin);
+}
+
+// internal: returns the pixel buffer for a track, which is always at the same place for each
+// track if in static memory (where there is room for all of the pixels), else NULL if failed
+byte *PixelNutEngine::AllocTrackBuff(int track, int numbytes)
+{
+  if (pStaticBuffs != NULL) return (pStaticBuffs + ((uint32_t)track * numPixels * 3));
+  return (byte*)malloc(numbytes);
+}
+
+void PixelNutEngine::FreeTrackBuff(byte *pbuff)
+{
+  if (pStaticBuffs == NULL) free(pbuff);
+}
+
 // return false if unsuccessful for any reason
 PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex, int pix_start, int pix_count)
 {
@@ -190,7 +263,7 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex,
     return Status_Error_Memory;
   }
 
-  PixelNutPlugin *pPlugin = pPluginFactory->makePlugin(plugin);
+  PixelNutPlugin *pPlugin = MakePlugin(plugin);
   if (pPlugin == NULL) return Status_Error_BadVal;
 
   // determine if must allocate buffer for track, or is a filter plugin
@@ -204,7 +277,7 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex,
   if ((!newtrack && (indexTrackStack < 0)) ||
       ( newtrack && ((indexTrackStack+1) >= maxPluginTracks)))
   {
-    delete pPlugin;
+    FreePlugin(pPlugin);
 
     if (newtrack)
     {
@@ -232,6 +305,8 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex,
     pTrack->segIndex  = segindex;
     pTrack->dspCount  = pix_count;
     pTrack->dspOffset = pix_start;
+    pTrack->pixOffset = 0;
+    pTrack->pixBytes  = (pPlugin->intensityonly() ? 1 : 3);
 
     // initialize track drawing properties: some must be set with user commands
     memset(&pTrack->draw, 0, sizeof(PixelNutSupport::DrawProps));
@@ -246,6 +321,7 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex,
 
   PluginLayer *pLayer = &pluginLayers[indexLayerStack];
   pLayer->track         = indexTrackStack;
+  pLayer->plugin        = plugin;
   pLayer->pPlugin       = pPlugin;
   pLayer->trigCount     = -1; // forever
   pLayer->trigDelayMin  = 1;  // 1 sec min
@@ -261,8 +337,8 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex,
 
   if (newtrack) // wait to do this until after any memory allocation in plugin
   {
-    int numbytes = pix_count*3;
-    byte *p = (byte*)malloc(numbytes);
+    int numbytes = pix_count * pluginTracks[indexTrackStack].pixBytes;
+    byte *p = AllocTrackBuff(indexTrackStack, numbytes);
 
     if (p == NULL)
     {
@@ -271,7 +347,7 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex,
 
       --indexTrackStack;
       --indexLayerStack;
-      delete pPlugin;
+      FreePlugin(pPlugin);
       return Status_Error_Memory;
     }
     DBG( else DBGOUT((F("Allocated %d bytes for pixel buffer"), numbytes)); )
@@ -279,8 +355,9 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex,
     memset(p, 0, numbytes);
     pluginTracks[indexTrackStack].pRedrawBuff = p;
   }
-  else pluginTracks[indexTrackStack].pRedrawBuff = NULL;
 
+  BuildRoutes(); // can now be triggered by layers assigned to it
+  UpdateMemory();
   return Status_Success;
 }
 
@@ -290,6 +367,8 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex,
 
 void PixelNutEngine::triggerLayer(byte layer, short force)
 {
+  if (propsPending) ApplyProps(); // plugin must see the latest properties
+
   PluginLayer *pLayer = &pluginLayers[layer];
   int track = pLayer->track;
   PluginTrack *pTrack = &pluginTracks[track];
@@ -311,9 +390,19 @@ void PixelNutEngine::triggerLayer(byte layer, short force)
   }
 
   byte *dptr = pDrawPixels;
+  uint16_t doff = drawOffset;
+  uint16_t dlen = drawLength;
+  byte dbytes = drawPixBytes;
   pDrawPixels = (predraw ? NULL : pTrack->pRedrawBuff); // prevent drawing if not drawing effect
+  drawOffset = pTrack->pixOffset;
+  drawLength = pTrack->dspCount;
+  drawPixBytes = pTrack->pixBytes;
   pLayer->pPlugin->trigger(this, &pTrack->draw, force);
-  pDrawPixels = dptr; // restore to the previous value
+  pTrack->pixOffset = drawOffset; // in case was scrolled
+  pDrawPixels = dptr; // restore to the previous values
+  drawOffset = doff;
+  drawLength = dlen;
+  drawPixBytes = dbytes;
 
   if (externPropMode) RestorePropVals(pTrack, pixCount, degreeHue, pcentWhite);
 
@@ -360,17 +449,98 @@ void PixelNutEngine::CheckAutoTrigger(bool rollover)
 // external: cause trigger if enabled in track
 void PixelNutEngine::triggerForce(short force)
 {
+  StopLoop(); // effects must be running to be triggered
+
   for (int i = 0; i <= indexLayerStack; ++i)
     if (pluginLayers[i].trigExtern)
       triggerLayer(i, force);
 }
 
-// internal: called from plugins
+// internal: called from plugins, queues trigger to be sent on next update
 void PixelNutEngine::triggerForce(byte layer, short force, PixelNutSupport::DrawProps *pdraw)
 {
-  for (int i = 0; i <= indexLayerStack; ++i)
-    if (layer == pluginLayers[i].trigSource)
-      triggerLayer(i, force);
+  if (layer > indexLayerStack) return;
+  if (routeIndex[layer] == routeIndex[layer+1]) return; // no layers assigned to it
+
+  // combine with trigger already waiting from this layer
+  for (int i = 0; i < trigQueueCount; ++i)
+  {
+    TriggerEvent *pevent = &trigQueue[(trigQueueHead + i) % TRIGGER_QUEUE_SIZE];
+    if (pevent->layer == layer)
+    {
+      pevent->force = force;
+      return;
+    }
+  }
+
+  if (trigQueueCount >= TRIGGER_QUEUE_SIZE)
+  {
+    DBGOUT((F("Trigger queue full: layer=%d force=%d"), layer, force));
+    ++trigDropped;
+    return;
+  }
+
+  TriggerEvent *pevent = &trigQueue[(trigQueueHead + trigQueueCount) % TRIGGER_QUEUE_SIZE];
+  pevent->layer = layer;
+  pevent->force = force;
+  ++trigQueueCount;
+}
+
+// internal: sends the triggers that are waiting to the layers assigned to them,
+// but only those already queued: any that result from these wait until the next update
+void PixelNutEngine::SendTriggers(void)
+{
+  byte count = trigQueueCount;
+  while (count--)
+  {
+    TriggerEvent event = trigQueue[trigQueueHead];
+    trigQueueHead = (trigQueueHead + 1) % TRIGGER_QUEUE_SIZE;
+    --trigQueueCount;
+
+    if (event.layer > indexLayerStack) continue; // no longer exists
+
+    for (int i = routeIndex[event.layer]; i < routeIndex[event.layer+1]; ++i)
+      triggerLayer(routeLayers[i], event.force);
+  }
+}
+
+// internal: rebuild the lists of layers triggered by each layer, which must be done
+// whenever a layer is added/removed, or the trigger source for a layer is changed
+void PixelNutEngine::BuildRoutes(void)
+{
+  int count = indexLayerStack+1;
+  memset(routeIndex, 0, count+1);
+
+  // count the layers triggered by each layer, then convert to starting indices
+  for (int i = 0; i < count; ++i)
+    if (pluginLayers[i].trigSource < count)
+      ++routeIndex[pluginLayers[i].trigSource+1];
+
+  for (int i = 1; i <= count; ++i)
+    routeIndex[i] += routeIndex[i-1];
+
+  // fill in the layers, using the start of the next layer as the current position,
+  // then shift them all back down so that each is at the start of its layer again
+  for (int i = 0; i < count; ++i)
+    if (pluginLayers[i].trigSource < count)
+      routeLayers[routeIndex[pluginLayers[i].trigSource]++] = i;
+
+  for (int i = count; i > 0; --i)
+    routeIndex[i] = routeIndex[i-1];
+  routeIndex[0] = 0;
+}
+
+// internal: returns true if having 'source' trigger 'layer' would create a cycle of triggers
+bool PixelNutEngine::RouteCycle(int layer, int source)
+{
+  // follow the sources that trigger the source (at most once through all layers)
+  for (int i = 0; (i <= indexLayerStack) && (source <= indexLayerStack); ++i)
+  {
+    if (source == layer) return true;
+    source = pluginLayers[source].trigSource;
+  }
+
+  return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -379,6 +549,7 @@ void PixelNutEngine::triggerForce(byte layer, short force, PixelNutSupport::Draw
 
 void PixelNutEngine::setPropertyMode(bool enable)
 {
+  if (enable != externPropMode) StopLoop();
   DBGOUT((F("Engine property mode: %s"), (enable ? "enabled" : "disabled")));
   externPropMode = enable;
 }
@@ -415,9 +586,18 @@ void PixelNutEngine::SetPropColor(void)
 
 void PixelNutEngine::setColorProperty(short hue_degree, byte white_percent)
 {
-  externDegreeHue = pixelNutSupport.clipValue(hue_degree, 0, MAX_DEGREES_HUE);
-  externPcentWhite = pixelNutSupport.clipValue(white_percent, 0, MAX_PERCENTAGE);
-  if (externPropMode) SetPropColor();
+  hue_degree = pixelNutSupport.clipValue(hue_degree, 0, MAX_DEGREES_HUE);
+  white_percent = pixelNutSupport.clipValue(white_percent, 0, MAX_PERCENTAGE);
+  if ((hue_degree != externDegreeHue) || (white_percent != externPcentWhite)) StopLoop();
+
+  externDegreeHue = hue_degree;
+  externPcentWhite = white_percent;
+
+  if (externPropMode) // applied on the next frame
+  {
+    if (propsPending & ExtControlBit_DegreeHue) ++propsCoalesced;
+    propsPending |= (ExtControlBit_DegreeHue | ExtControlBit_PcentWhite);
+  }
 }
 
 void PixelNutEngine::SetPropCount(void)
@@ -442,8 +622,24 @@ void PixelNutEngine::SetPropCount(void)
 void PixelNutEngine::setCountProperty(byte pixcount_percent)
 {
   // clip and map value into a pixel count, dependent on the actual number of pixels
-  externPcentCount = pixelNutSupport.clipValue(pixcount_percent, 0, MAX_PERCENTAGE);
-  if (externPropMode) SetPropCount();
+  pixcount_percent = pixelNutSupport.clipValue(pixcount_percent, 0, MAX_PERCENTAGE);
+  if (pixcount_percent != externPcentCount) StopLoop();
+
+  externPcentCount = pixcount_percent;
+
+  if (externPropMode) // applied on the next frame
+  {
+    if (propsPending & ExtControlBit_PixCount) ++propsCoalesced;
+    propsPending |= ExtControlBit_PixCount;
+  }
+}
+
+// internal: applies the latest property values that have been set since the previous frame
+void PixelNutEngine::ApplyProps(void)
+{
+  if (propsPending & ExtControlBit_DegreeHue) SetPropColor();
+  if (propsPending & ExtControlBit_PixCount)  SetPropCount();
+  propsPending = 0;
 }
 
 // internal: restore property values for bits set for track
@@ -494,6 +690,8 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
   char *cmd = strtok(cmdstr, " "); // separate options by spaces
 
   if (cmd == NULL) return Status_Success; // ignore empty line
+
+  StopLoop(); // commands change the effects
   do
   {
     PixelNutSupport::DrawProps *pdraw;
@@ -660,8 +858,17 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
         }
         case 'A': // Assign effect layer as trigger source for current plugin layer ("A" is same as "A0", "A255" disables)
         {
-          pluginLayers[curlayer].trigSource = GetNumValue(cmd+1, 0, MAX_BYTE_VALUE); // clip to 0-MAX_BYTE_VALUE
+          short source = GetNumValue(cmd+1, 0, MAX_BYTE_VALUE); // clip to 0-MAX_BYTE_VALUE
+          if (RouteCycle(curlayer, source))
+          {
+            DBGOUT((F("Triggering from layer %d would cycle back to layer %d"), source, curlayer));
+            status = Status_Error_BadVal;
+            break;
+          }
+
+          pluginLayers[curlayer].trigSource = source;
           DBGOUT((F("Triggering assigned to layer %d"), pluginLayers[curlayer].trigSource));
+          BuildRoutes();
           break;
         }
         case 'F': // set Force value to be used by trigger ("F" causes random force to be used)
@@ -735,15 +942,115 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
   return status;
 }
 
-bool PixelNutEngine::updateEffects(void)
+void PixelNutEngine::setFrameRate(byte fps, FramePolicy policy)
 {
-  bool doshow = (timePrevUpdate == 0);
+  DBGOUT((F("Engine frame rate: %d fps policy=%d"), fps, policy));
+  StopLoop();
+
+  framesPerSec = fps;
+  framePolicy = policy;
+  msecsPerFrame = (fps ? ((1000 + (fps/2)) / fps) : 0);
+  timeNextFrame = 0; // start on next update
+}
+
+// internal: returns true if all active effects for a track can advance by elapsed time
+bool PixelNutEngine::TimedTrack(int track)
+{
+  for (int j = 0; j <= indexLayerStack; ++j)
+    if ((pluginLayers[j].track == track) && pluginLayers[j].trigActive &&
+        !(pluginLayers[j].pPlugin->gettype() & PLUGIN_TYPE_TIMESTEP))
+          return false;
 
+  return true;
+}
+
+// internal: call all predraw effects for a track, then its drawing effect,
+// using timedstep() with the elapsed time instead of nextstep() if 'msecs' is set
+void PixelNutEngine::StepTrack(int track, PluginTrack *pTrack, uint16_t msecs)
+{
+  short pixCount = 0;
+  short degreeHue = 0;
+  byte pcentWhite = 0;
+
+  // prevent predraw effect from overwriting properties if in extern mode
+  if (externPropMode)
+  {
+    pixCount = pTrack->draw.pixCount;
+    degreeHue = pTrack->draw.degreeHue;
+    pcentWhite = pTrack->draw.pcentWhite;
+  }
+
+  pDrawPixels = NULL; // prevent drawing by predraw effects
+
+  // call all of the predraw effects associated with this track
+  for (int j = 0; j <= indexLayerStack; ++j)
+  {
+    if ((pluginLayers[j].track == track) && pluginLayers[j].trigActive &&
+        (pluginLayers[j].pPlugin->gettype() & PLUGIN_TYPE_PREDRAW))
+    {
+      if (msecs) pluginLayers[j].pPlugin->timedstep(this, &pTrack->draw, msecs);
+      else       pluginLayers[j].pPlugin->nextstep(this, &pTrack->draw);
+    }
+  }
+
+  if (externPropMode) RestorePropVals(pTrack, pixCount, degreeHue, pcentWhite);
+
+  // now the main drawing effect is executed for this track
+  pDrawPixels = pTrack->pRedrawBuff; // switch to drawing buffer
+  drawOffset = pTrack->pixOffset;
+  drawLength = pTrack->dspCount;
+  drawPixBytes = pTrack->pixBytes;
+  if (msecs) pluginLayers[pTrack->layer].pPlugin->timedstep(this, &pTrack->draw, msecs);
+  else       pluginLayers[pTrack->layer].pPlugin->nextstep(this, &pTrack->draw);
+  pTrack->pixOffset = drawOffset; // in case was scrolled
+  pDrawPixels = pDisplayPixels; // restore to default (display buffer)
+  drawOffset = 0;
+  drawLength = 0;
+  drawPixBytes = 3;
+}
+
+bool PixelNutEngine::updateEffects(void)
+{
   uint32_t time = pixelNutSupport.getMsecs();
+
+  #if (COMMAND_QUEUE_SIZE > 0)
+  if (cmdQueueHead != cmdQueueTail) QueueDrain(time); // before anything looks at the effects
+  #endif
+
+  bool doshow = (timePrevUpdate == 0);
   bool rollover = (timePrevUpdate > time);
+
+  if (loopState == LoopState_Playing) // no plugins are called while playing back a loop
+  {
+    if (!rollover)
+    {
+      bool doplay = PlayLoop(time);
+      if (doplay && maxChangeRanges) FindChanges();
+      if (doplay && numOutputs) ShowOutputs();
+      return doplay;
+    }
+    StopLoop();
+  }
+
+  if (msecsPerFrame) // only update on frame boundaries
+  {
+    if (rollover || doshow) timeNextFrame = time;
+    else if (time < timeNextFrame) return false;
+
+    timeNextFrame += msecsPerFrame;
+    if (timeNextFrame <= time) // fell behind by more than a frame: drop frames
+      timeNextFrame = time + msecsPerFrame;
+  }
+
   timePrevUpdate = time;
 
+  if (propsPending) ApplyProps(); // once for all the values set since the previous frame
+
   CheckAutoTrigger(rollover);
+  SendTriggers();
+
+  // when catching up, tracks are stepped from when they were due, not the current time
+  bool catchup = (msecsPerFrame && (framePolicy == FramePolicy_CatchUp));
 
   // first have any redraw effects that are ready draw into its own buffers...
 
@@ -766,38 +1073,41 @@ bool PixelNutEngine::updateEffects(void)
 
     //DBGOUT((F("redraw buffer: track=%d msecs=%lu"), i, pTrack->msTimeRedraw));
 
-    short pixCount = 0;
-    short degreeHue = 0;
-    byte pcentWhite = 0;
+    short addtime = pTrack->draw.msecsDelay + delayOffset;
+    if (addtime <= 0) addtime = 1; // must advance at least by 1 each time
 
-    // prevent predraw effect from overwriting properties if in extern mode
-    if (externPropMode)
+    if (catchup && TimedTrack(i)) // catch up with a single step of all the elapsed time
     {
-      pixCount = pTrack->draw.pixCount;
-      degreeHue = pTrack->draw.degreeHue;
-      pcentWhite = pTrack->draw.pcentWhite;
-    }
+      uint32_t msecs = (timePrevUpdate - pTrack->msTimeRedraw) + addtime;
+      if (msecs > ((uint32_t)addtime * MAX_CATCHUP_STEPS))
+        msecs = ((uint32_t)addtime * MAX_CATCHUP_STEPS);
 
-    pDrawPixels = NULL; // prevent drawing by predraw effects
+      StepTrack(i, pTrack, msecs);
 
-    // call all of the predraw effects associated with this track
-    for (int j = 0; j <= indexLayerStack; ++j)
-      if ((pluginLayers[j].track == i) && pluginLayers[j].trigActive &&
-          (pluginLayers[j].pPlugin->gettype() & PLUGIN_TYPE_PREDRAW))
-            pluginLayers[j].pPlugin->nextstep(this, &pTrack->draw);
+      addtime = pTrack->draw.msecsDelay + delayOffset;
+      if (addtime <= 0) addtime = 1;
+      pTrack->msTimeRedraw = timePrevUpdate + addtime;
+    }
+    else
+    {
+      byte steps = 0;
+      do
+      {
+        StepTrack(i, pTrack, 0);
 
-    if (externPropMode) RestorePropVals(pTrack, pixCount, degreeHue, pcentWhite);
+        //DBGOUT((F("delay=%d.%d"), pTrack->draw.msecsDelay, delayOffset));
 
-    // now the main drawing effect is executed for this track
-    pDrawPixels = pTrack->pRedrawBuff; // switch to drawing buffer
-    pluginLayers[pTrack->layer].pPlugin->nextstep(this, &pTrack->draw);
-    pDrawPixels = pDisplayPixels; // restore to default (display buffer)
+        addtime = pTrack->draw.msecsDelay + delayOffset;
+        if (addtime <= 0) addtime = 1; // must advance at least by 1 each time
 
-    //DBGOUT((F("delay=%d.%d"), pTrack->draw.msecsDelay, delayOffset));
+        if (catchup) pTrack->msTimeRedraw += addtime;
+        else pTrack->msTimeRedraw = timePrevUpdate + addtime;
+      }
+      while ((pTrack->msTimeRedraw <= timePrevUpdate) && (++steps < MAX_CATCHUP_STEPS));
 
-    short addtime = pTrack->draw.msecsDelay + delayOffset;
-    if (addtime <= 0) addtime = 1; // must advance at least by 1 each time
-    pTrack->msTimeRedraw = timePrevUpdate + addtime;
+      if (pTrack->msTimeRedraw <= timePrevUpdate) // still behind: drop the rest
+        pTrack->msTimeRedraw = timePrevUpdate + addtime;
+    }
 
     doshow = true;
   }
@@ -824,26 +1134,49 @@ bool PixelNutEngine::updateEffects(void)
       if (pixend > pixlast) pixend -= (pixlast+1);
 
       short pix = (pTrack->draw.goUpwards ? pixstart : pixend);
-      short x = pix * 3;
-      short y = pTrack->draw.pixStart * 3;
+      int x = pix * 3; // byte offsets overflow a short on long strips
+      int pixbytes = pTrack->pixBytes;
+      int ylen = pTrack->dspCount * pixbytes;
+      int y = pTrack->draw.pixStart + pTrack->pixOffset; // read from scrolled position
+      y = ((y >= pTrack->dspCount) ? (y - pTrack->dspCount) : y) * pixbytes;
+
+      // intensity only buffers are colored with the track color here, in pixel order,
+      // scaled exactly as 'setPixel()' would have (floor(v/255) for v <= 255*255)
+      byte color[3], vals[3];
+      if (pixbytes == 1)
+      {
+        byte full = MAX_BYTE_VALUE;
+        pixelNutSupport.makePixelVals(pTrack->draw.r, pTrack->draw.g, pTrack->draw.b, &full, 1, color);
+      }
 
       while(true)
       {
         //DBGOUT((F(">> start.end=%d.%d pix=%d x=%d y=%d"), pixstart, pixend, pix, x, y));
 
+        byte *pv = (pTrack->pRedrawBuff + y);
+        if (pixbytes == 1)
+        {
+          uint16_t level = *pv;
+          uint16_t v0 = color[0] * level;
+          uint16_t v1 = color[1] * level;
+          uint16_t v2 = color[2] * level;
+          vals[0] = ((v0 + (v0 >> 8) + 1) >> 8);
+          vals[1] = ((v1 + (v1 >> 8) + 1) >> 8);
+          vals[2] = ((v2 + (v2 >> 8) + 1) >> 8);
+          pv = vals;
+        }
+
         if (pTrack->draw.orPixelValues)
         {
-          pDisplayPixels[x+0] |= pTrack->pRedrawBuff[y+0];
-          pDisplayPixels[x+1] |= pTrack->pRedrawBuff[y+1];
-          pDisplayPixels[x+2] |= pTrack->pRedrawBuff[y+2];
+          pDisplayPixels[x+0] |= pv[0];
+          pDisplayPixels[x+1] |= pv[1];
+          pDisplayPixels[x+2] |= pv[2];
         }
-        else if ((pTrack->pRedrawBuff[y+0] != 0) ||
-                 (pTrack->pRedrawBuff[y+1] != 0) ||
-                 (pTrack->pRedrawBuff[y+2] != 0))
+        else if ((pv[0] != 0) || (pv[1] != 0) || (pv[2] != 0))
         {
-          pDisplayPixels[x+0] = pTrack->pRedrawBuff[y+0];
-          pDisplayPixels[x+1] = pTrack->pRedrawBuff[y+1];
-          pDisplayPixels[x+2] = pTrack->pRedrawBuff[y+2];
+          pDisplayPixels[x+0] = pv[0];
+          pDisplayPixels[x+1] = pv[1];
+          pDisplayPixels[x+2] = pv[2];
         }
 
         if (pTrack->draw.goUpwards)
@@ -875,7 +1208,8 @@ bool PixelNutEngine::updateEffects(void)
             x -= 3;
           }
         }
-        y += 3;
+        y += pixbytes;
+        if (y >= ylen) y = 0; // wrap around to start of buffer
       }
     }
 
@@ -884,7 +1218,1311 @@ bool PixelNutEngine::updateEffects(void)
     for (int i = 0; i < numPixels; ++i)
       DBGOUT((F("%d.%d.%d"), *p++, *p++, *p++));
     */
+
+    if (loopState == LoopState_Searching) RecordLoop(time);
+    if (maxChangeRanges) FindChanges();
+    if (numOutputs) ShowOutputs();
   }
 
   return doshow;
 }
+
+uint32_t PixelNutEngine::nextUpdateTime(void)
+{
+  uint32_t time = pixelNutSupport.getMsecs();
+  uint32_t next = 0; // 0 if nothing is scheduled
+
+  #if (COMMAND_QUEUE_SIZE > 0)
+  if (QueueWaiting(time, &next)) return time; // else sets 'next' if a trigger waits for its time
+  #endif
+
+  if (loopState == LoopState_Playing)
+  {
+    uint32_t play = ((loopTimeNext > time) ? loopTimeNext : time);
+    return ((next && (next < play)) ? next : play);
+  }
+
+  // pixels haven't been shown yet, or triggers from plugins are waiting to be sent
+  if ((timePrevUpdate == 0) || trigQueueCount) return time;
+
+  if (propsPending) next = time; // property values are applied on the next frame
+
+  for (int i = 0; i <= indexLayerStack; ++i) // same checks as in CheckAutoTrigger()
+  {
+    if (pluginLayers[i].track > indexTrackEnable) break;
+
+    if (pluginLayers[i].trigActive && pluginLayers[i].trigCount &&
+        (pluginLayers[i].trigTimeMsecs > 0) &&
+        (!next || (pluginLayers[i].trigTimeMsecs < next)))
+      next = pluginLayers[i].trigTimeMsecs;
+  }
+
+  PluginTrack *pTrack = pluginTracks;
+  for (int i = 0; i <= indexTrackStack; ++i, ++pTrack) // same checks as in updateEffects()
+  {
+    if (i > indexTrackEnable) break;
+
+    if (!(pluginLayers[pTrack->layer].pPlugin->gettype() & PLUGIN_TYPE_REDRAW)) continue;
+    if (!pluginLayers[pTrack->layer].trigActive) continue;
+
+    if (!next || (pTrack->msTimeRedraw < next)) next = pTrack->msTimeRedraw;
+  }
+
+  if (!next) return 0;
+
+  if (msecsPerFrame && (next < timeNextFrame)) next = timeNextFrame; // wait for frame boundary
+  if (next < time) next = time; // already overdue
+
+  return next;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Engine state save/restore routines
+// The saved state is a header, followed by each track, then each layer with the state of its plugin,
+// and finally the pixel buffer for each track (which can be left out). All times are saved relative
+// to the current time, and the buffers as if they had never been scrolled. The tracks and layers are
+// saved without their pointers, so that (as with the plugin states) the saved state is the same on
+// any processor, and can be made on one and loaded on another.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define STATE_VERSION 5 // must be changed whenever the format of the saved state changes
+
+// bytes saved for each track/layer (which are packed): all but the pixel buffer pointer
+// that follows the redraw time in a track, and the plugin pointer at the end of a layer
+#define TRACK_STATE_LEN (sizeof(PluginTrack) - sizeof(byte*))
+#define LAYER_STATE_LEN (sizeof(PluginLayer) - sizeof(PixelNutPlugin*))
+
+typedef struct ATTR_PACKED
+{
+  byte version;                                 // must be STATE_VERSION
+  byte sizeLayer, sizeTrack;                    // bytes saved for each layer/track (must match)
+  byte numLayers, numTracks;                    // number of layers/tracks saved
+  byte numEnabled;                              // number of those tracks that are active
+  uint16_t numPixels;                           // must match the number of pixels in the display
+
+  byte pcentBright;                             // engine settings that can be changed at any time
+  int8_t delayOffset;
+  uint16_t firstPixel;
+  bool goUpwards;
+  uint16_t segOffset, segCount;
+
+  bool externPropMode;                          // external property mode settings
+  short externDegreeHue;
+  byte externPcentWhite;
+  byte externPcentCount;
+}
+StateHeader; // defines start of the saved engine state
+
+typedef struct
+{
+  byte *pbuff;                                  // start of the state buffer (NULL if none)
+  uint32_t maxlen;                              // number of bytes in that buffer
+  uint32_t offset;                              // current offset (can be past the end)
+}
+StateBuff; // used to write the saved engine state
+
+typedef struct
+{
+  const byte *pbuff;                            // start of the saved state
+  uint32_t maxlen;                              // number of bytes in that state
+  uint32_t offset;                              // current offset
+}
+StateData; // used to read the saved engine state
+
+// appends 'len' bytes from 'pdata' (if not NULL) to the state,
+// returning where it was put, or NULL if there isn't room for it
+static byte *PutState(StateBuff *pstate, const void *pdata, uint32_t len)
+{
+  byte *p = NULL;
+  if ((pstate->pbuff != NULL) && ((pstate->offset + len) <= pstate->maxlen))
+  {
+    p = (pstate->pbuff + pstate->offset);
+    if (pdata != NULL) memcpy(p, pdata, len);
+  }
+
+  pstate->offset += len;
+  return p;
+}
+
+// returns pointer to the next 'len' bytes of the state, or NULL if not that many left
+static const byte *GetState(StateData *pstate, uint32_t len)
+{
+  if ((pstate->offset + len) > pstate->maxlen) return NULL;
+
+  const byte *p = (pstate->pbuff + pstate->offset);
+  pstate->offset += len;
+  return p;
+}
+
+uint32_t PixelNutEngine::saveState(byte *pbuff, uint32_t maxlen, bool pixels)
+{
+  if (loopState == LoopState_Playing) StopLoop(); // bring the effects up to date first
+  if (propsPending) ApplyProps();
+
+  uint32_t time = pixelNutSupport.getMsecs();
+  StateBuff sbuff = { pbuff, maxlen, 0 };
+
+  StateHeader header;
+  header.version          = STATE_VERSION;
+  header.sizeLayer        = LAYER_STATE_LEN;
+  header.sizeTrack        = TRACK_STATE_LEN;
+  header.numLayers        = indexLayerStack+1;
+  header.numTracks        = indexTrackStack+1;
+  header.numEnabled       = indexTrackEnable+1;
+  header.numPixels        = numPixels;
+  header.pcentBright      = pcentBright;
+  header.delayOffset      = delayOffset;
+  header.firstPixel       = firstPixel;
+  header.goUpwards        = goUpwards;
+  header.segOffset        = segOffset;
+  header.segCount         = segCount;
+  header.externPropMode   = externPropMode;
+  header.externDegreeHue  = externDegreeHue;
+  header.externPcentWhite = externPcentWhite;
+  header.externPcentCount = externPcentCount;
+  PutState(&sbuff, &header, sizeof(header));
+
+  for (int i = 0; i <= indexTrackStack; ++i)
+  {
+    PluginTrack track;
+    memcpy(&track, &pluginTracks[i], sizeof(PluginTrack));
+    track.msTimeRedraw = (uint32_t)(int32_t)(track.msTimeRedraw - time); // can be negative
+    track.pixOffset = 0; // buffer is saved unscrolled (below)
+    PutState(&sbuff, &track.msTimeRedraw, sizeof(uint32_t));
+    PutState(&sbuff, &track.draw, (TRACK_STATE_LEN - sizeof(uint32_t)));
+  }
+
+  for (int i = 0; i <= indexLayerStack; ++i)
+  {
+    PluginLayer layer;
+    memcpy(&layer, &pluginLayers[i], sizeof(PluginLayer));
+    if (layer.trigTimeMsecs > 0) // keep set if already expired
+      layer.trigTimeMsecs = ((layer.trigTimeMsecs > time) ? (layer.trigTimeMsecs - time) : 1);
+    PutState(&sbuff, &layer, LAYER_STATE_LEN);
+
+    uint16_t len = pluginLayers[i].pPlugin->savestate(NULL);
+    PutState(&sbuff, &len, sizeof(len));
+
+    byte *p = PutState(&sbuff, NULL, len);
+    if (p != NULL) pluginLayers[i].pPlugin->savestate(p);
+  }
+
+  // starting with the first pixel, so that the same pixels are always saved the same way
+  for (int i = 0; pixels && (i <= indexTrackStack); ++i)
+  {
+    PluginTrack *pTrack = &pluginTracks[i];
+    uint32_t first = (pTrack->pixOffset * pTrack->pixBytes);
+    uint32_t numbytes = (pTrack->dspCount * pTrack->pixBytes);
+
+    PutState(&sbuff, (pTrack->pRedrawBuff + first), (numbytes - first));
+    PutState(&sbuff, pTrack->pRedrawBuff, first);
+  }
+
+  if ((pbuff != NULL) && (sbuff.offset > maxlen))
+  {
+    DBGOUT((F("Saving state needs %lu bytes: max=%lu"), sbuff.offset, maxlen));
+    return 0;
+  }
+
+  DBGOUT((F("Saved state: %lu bytes layers=%d tracks=%d"), sbuff.offset, header.numLayers, header.numTracks));
+  return sbuff.offset;
+}
+
+// internal: restores the tracks and layers from the state after the header
+PixelNutEngine::Status PixelNutEngine::LoadStack(const byte *pbuff, uint32_t len,
+                                                 byte numlayers, byte numtracks)
+{
+  StateData sbuff = { pbuff, len, 0 };
+  uint32_t time = pixelNutSupport.getMsecs();
+
+  for (int i = 0; i < numtracks; ++i)
+  {
+    PluginTrack *pTrack = &pluginTracks[i];
+    const byte *p = GetState(&sbuff, TRACK_STATE_LEN);
+    if (p == NULL) return Status_Error_BadVal;
+
+    memcpy(&pTrack->msTimeRedraw, p, sizeof(uint32_t));
+    memcpy(&pTrack->draw, (p + sizeof(uint32_t)), (TRACK_STATE_LEN - sizeof(uint32_t)));
+    pTrack->pRedrawBuff = NULL;
+    indexTrackStack = i;
+
+    // the drawing window must be within the display
+    if ((pTrack->layer >= numlayers) || (pTrack->pixOffset >= pTrack->dspCount) ||
+        (((uint32_t)pTrack->dspOffset + pTrack->dspCount) > numPixels))
+      return Status_Error_BadVal;
+
+    int32_t msecs = (int32_t)pTrack->msTimeRedraw;
+    pTrack->msTimeRedraw = ((msecs > 0) ? (time + msecs) : time);
+  }
+
+  for (int i = 0; i < numlayers; ++i)
+  {
+    PluginLayer *pLayer = &pluginLayers[i];
+    uint16_t statelen;
+
+    const byte *p = GetState(&sbuff, LAYER_STATE_LEN);
+    const byte *plen = GetState(&sbuff, sizeof(statelen));
+    if ((p == NULL) || (plen == NULL)) return Status_Error_BadVal;
+
+    memcpy(pLayer, p, LAYER_STATE_LEN);
+    memcpy(&statelen, plen, sizeof(statelen));
+
+    const byte *pstate = GetState(&sbuff, statelen);
+    if ((pstate == NULL) || (pLayer->track >= numtracks)) return Status_Error_BadVal;
+
+    if (pLayer->trigTimeMsecs > 0) pLayer->trigTimeMsecs += time;
+
+    pLayer->pPlugin = MakePlugin(pLayer->plugin);
+    if (pLayer->pPlugin == NULL) return Status_Error_BadVal;
+    indexLayerStack = i;
+
+    // restart the plugin only if cannot restore its state
+    uint16_t pixlen = pluginTracks[pLayer->track].dspCount;
+    if (!statelen || !pLayer->pPlugin->loadstate(i, pixlen, pstate, statelen))
+    {
+      DBGOUT((F("Restarting plugin #%d: layer=%d"), pLayer->plugin, i));
+      pLayer->pPlugin->begin(i, pixlen);
+    }
+  }
+
+  // the pixel buffers are cleared if they were left out
+  bool pixels = (sbuff.offset < len);
+
+  // wait to do this until after any memory allocation in plugins
+  for (int i = 0; i < numtracks; ++i)
+  {
+    // buffer format must be the one the drawing plugin uses
+    byte pixbytes = (pluginLayers[pluginTracks[i].layer].pPlugin->intensityonly() ? 1 : 3);
+    if (pluginTracks[i].pixBytes != pixbytes) return Status_Error_BadVal;
+
+    int numbytes = pluginTracks[i].dspCount * pixbytes;
+    const byte *p = (pixels ? GetState(&sbuff, numbytes) : NULL);
+    if (pixels && (p == NULL)) return Status_Error_BadVal;
+
+    pluginTracks[i].pRedrawBuff = AllocTrackBuff(i, numbytes);
+    if (pluginTracks[i].pRedrawBuff == NULL)
+    {
+      DBGOUT((F("!!! Memory alloc for %d bytes failed !!!"), numbytes));
+      return Status_Error_Memory;
+    }
+
+    if (p != NULL) memcpy(pluginTracks[i].pRedrawBuff, p, numbytes);
+    else memset(pluginTracks[i].pRedrawBuff, 0, numbytes);
+  }
+
+  BuildRoutes();
+  UpdateMemory();
+  return Status_Success;
+}
+
+PixelNutEngine::Status PixelNutEngine::loadState(const byte *pbuff, uint32_t len)
+{
+  const StateHeader *phead = (const StateHeader*)pbuff;
+  StopLoop();
+
+  if ((pbuff == NULL) || (len < sizeof(StateHeader))  ||
+      (phead->version   != STATE_VERSION)             ||
+      (phead->sizeLayer != LAYER_STATE_LEN)           ||
+      (phead->sizeTrack != TRACK_STATE_LEN)           ||
+      (phead->numPixels != numPixels)                 ||
+      (phead->numLayers  > maxPluginLayers)           ||
+      (phead->numTracks  > maxPluginTracks)           ||
+      (phead->numTracks  > phead->numLayers)          ||
+      (phead->numEnabled > phead->numTracks))
+  {
+    DBGOUT((F("Invalid engine state: len=%lu"), len));
+    return Status_Error_BadVal;
+  }
+
+  FreeStack(); // replaces all current effects
+
+  pcentBright      = phead->pcentBright;
+  delayOffset      = phead->delayOffset;
+  firstPixel       = phead->firstPixel;
+  goUpwards        = phead->goUpwards;
+  segOffset        = phead->segOffset;
+  segCount         = phead->segCount;
+  externPropMode   = phead->externPropMode;
+  externDegreeHue  = phead->externDegreeHue;
+  externPcentWhite = phead->externPcentWhite;
+  externPcentCount = phead->externPcentCount;
+
+  Status status = LoadStack((pbuff + sizeof(StateHeader)), (len - sizeof(StateHeader)),
+                            phead->numLayers, phead->numTracks);
+
+  timePrevUpdate = 0; // redisplay pixels on next update
+
+  if (status != Status_Success)
+  {
+    DBGOUT((F("Failed to restore state: status=%d"), status));
+    FreeStack();
+    memset(pDisplayPixels, 0, (numPixels*3)); // must clear if nothing will be drawn
+    return status;
+  }
+
+  indexTrackEnable = phead->numEnabled-1;
+
+  DBGOUT((F("Restored state: layers=%d tracks=%d"), phead->numLayers, phead->numTracks));
+  return Status_Success;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Pattern cache routines
+// Each cached pattern has its own layer/track stacks: the engine's stack pointers and indices are
+// those of the active pattern, with the others saved in its slot while another one is displayed.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// internal: saves the stack of the active pattern, then makes the one in 'slot' the active one
+void PixelNutEngine::SelectPattern(byte slot)
+{
+  PatternSlot *pslot = &patternSlots[activePatternSlot];
+  pslot->memBytes         = StackBytes(); // includes anything added since it was built
+  pslot->indexLayerStack  = indexLayerStack;
+  pslot->indexTrackStack  = indexTrackStack;
+  pslot->indexTrackEnable = indexTrackEnable;
+  pslot->segOffset        = segOffset;
+  pslot->segCount         = segCount;
+
+  pslot = &patternSlots[slot];
+  pluginLayers     = pslot->pluginLayers;
+  pluginTracks     = pslot->pluginTracks;
+  indexLayerStack  = pslot->indexLayerStack;
+  indexTrackStack  = pslot->indexTrackStack;
+  indexTrackEnable = pslot->indexTrackEnable;
+  segOffset        = pslot->segOffset;
+  segCount         = pslot->segCount;
+
+  activePatternSlot = slot;
+  trigQueueCount = 0; // triggers were for the other pattern
+  BuildRoutes();
+}
+
+// internal: frees all plugins and buffers of a pattern that is not the active one
+void PixelNutEngine::EvictPattern(byte slot)
+{
+  DBGOUT((F("Evict pattern #%u: slot=%d bytes=%lu"), patternSlots[slot].patternId, slot, patternSlots[slot].memBytes));
+
+  // switching slots drops the queued triggers, but these are for the active pattern
+  byte trighead = trigQueueHead;
+  byte trigcount = trigQueueCount;
+
+  byte active = activePatternSlot;
+  SelectPattern(slot);
+  FreeStack();
+  SelectPattern(active);
+
+  trigQueueHead = trighead;
+  trigQueueCount = trigcount;
+}
+
+// internal: frees all cached patterns except for the active one
+void PixelNutEngine::ClearPatternCache(void)
+{
+  if (patternSlots == NULL) return;
+
+  for (int i = 0; i < numPatternSlots; ++i)
+  {
+    if (i == activePatternSlot) continue; // keep the stacks of the current pattern
+
+    EvictPattern(i);
+    free(patternSlots[i].pluginLayers);
+    free(patternSlots[i].pluginTracks);
+  }
+
+  free(patternSlots);
+  patternSlots = NULL;
+  numPatternSlots = 0;
+  activePatternSlot = 0;
+  UpdateMemory();
+}
+
+bool PixelNutEngine::setPatternCache(byte count, uint32_t maxbytes)
+{
+  DBGOUT((F("Pattern cache: count=%d maxbytes=%lu"), count, maxbytes));
+  StopLoop();
+
+  ClearPatternCache();
+  patternMaxBytes = maxbytes;
+
+  if (count <= 1) return true; // just the current pattern
+  if (pStaticBuffs != NULL) return false; // cannot allocate stacks for other patterns
+
+  PatternSlot *pslots = (PatternSlot*)malloc(count * sizeof(PatternSlot));
+  if (pslots == NULL) return false;
+  memset(pslots, 0, (count * sizeof(PatternSlot)));
+
+  // the current effects become the first pattern
+  pslots[0].pluginLayers = pluginLayers;
+  pslots[0].pluginTracks = pluginTracks;
+  pslots[0].patternId    = MAX_WORD_VALUE;
+
+  for (int i = 1; i < count; ++i)
+  {
+    PatternSlot *pslot = &pslots[i];
+    pslot->pluginLayers = (PluginLayer*)malloc(maxPluginLayers * sizeof(PluginLayer));
+    pslot->pluginTracks = (PluginTrack*)malloc(maxPluginTracks * sizeof(PluginTrack));
+
+    if ((pslot->pluginLayers == NULL) || (pslot->pluginTracks == NULL))
+    {
+      DBGOUT((F("Cannot allocate stacks for pattern cache: slot=%d"), i));
+
+      for (int j = 1; j <= i; ++j) // free(NULL) does nothing
+      {
+        free(pslots[j].pluginLayers);
+        free(pslots[j].pluginTracks);
+      }
+      free(pslots);
+      return false;
+    }
+
+    pslot->indexLayerStack  = -1;
+    pslot->indexTrackStack  = -1;
+    pslot->indexTrackEnable = -1;
+    pslot->segOffset        = 0;
+    pslot->segCount         = numPixels;
+    pslot->patternId        = MAX_WORD_VALUE;
+  }
+
+  patternSlots = pslots;
+  numPatternSlots = count;
+  activePatternSlot = 0;
+  return true;
+}
+
+PixelNutEngine::Status PixelNutEngine::switchPattern(uint16_t id, char *cmdstr)
+{
+  StopLoop();
+
+  if (patternSlots == NULL) // no cache: just replace the current pattern
+  {
+    clearStack();
+    timePrevUpdate = 0; // redisplay pixels after being cleared
+    return execCmdStr(cmdstr);
+  }
+
+  if (id == MAX_WORD_VALUE) return Status_Error_BadVal;
+
+  ++patternUses;
+
+  // look for the pattern, or an unused slot, else the least recently used one
+  int slot = -1, newslot = -1;
+  for (int i = 0; i < numPatternSlots; ++i)
+  {
+    PatternSlot *pslot = &patternSlots[i];
+    if (pslot->patternId == id)
+    {
+      slot = i;
+      break;
+    }
+
+    if (i == activePatternSlot) continue;
+
+    if ((newslot < 0) || (pslot->patternId == MAX_WORD_VALUE) ||
+        ((patternSlots[newslot].patternId != MAX_WORD_VALUE) &&
+         (pslot->lastUse < patternSlots[newslot].lastUse)))
+      newslot = i;
+  }
+
+  if (slot >= 0) // already built: just switch to it
+  {
+    DBGOUT((F("Switch to pattern #%u: slot=%d"), id, slot));
+
+    if (slot != activePatternSlot)
+    {
+      SelectPattern(slot);
+      timePrevUpdate = 0; // redisplay pixels from this pattern
+    }
+
+    patternSlots[slot].lastUse = patternUses;
+    return Status_Success;
+  }
+
+  DBGOUT((F("Build pattern #%u: slot=%d (was #%u)"), id, newslot, patternSlots[newslot].patternId));
+
+  byte prevslot = activePatternSlot;
+  SelectPattern(newslot);
+  FreeStack(); // evict whatever was in it
+
+  Status status = execCmdStr(cmdstr);
+  if (status != Status_Success) // keep displaying the previous pattern
+  {
+    FreeStack();
+    SelectPattern(prevslot);
+    return status;
+  }
+
+  PatternSlot *pslot = &patternSlots[newslot];
+  pslot->patternId = id;
+  pslot->lastUse = patternUses;
+  pslot->memBytes = StackBytes();
+
+  if (patternMaxBytes) // evict least recently used patterns until within the limit
+  {
+    while(true)
+    {
+      uint32_t total = 0;
+      int oldslot = -1;
+
+      for (int i = 0; i < numPatternSlots; ++i)
+      {
+        total += patternSlots[i].memBytes;
+
+        if ((i != activePatternSlot) && (patternSlots[i].patternId != MAX_WORD_VALUE) &&
+            ((oldslot < 0) || (patternSlots[i].lastUse < patternSlots[oldslot].lastUse)))
+          oldslot = i;
+      }
+
+      if ((total <= patternMaxBytes) || (oldslot < 0)) break;
+      EvictPattern(oldslot);
+    }
+  }
+
+  timePrevUpdate = 0; // redisplay pixels from this pattern
+  return Status_Success;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory accounting routines
+// Counts the memory for the effects: the pixel buffer of each track, and each plugin object along
+// with the memory it allocates itself, as reported by the plugin factory and the plugins.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// internal: returns the amount of memory used by a plugin for 'pixlen' pixels
+uint32_t PixelNutEngine::PluginBytes(int plugin, PixelNutPlugin *pPlugin, uint16_t pixlen)
+{
+  return (Factory()->sizePlugin(plugin) + pPlugin->memsize(pixlen));
+}
+
+// internal: returns the amount of memory used by the plugins and pixel buffers of the current stack
+uint32_t PixelNutEngine::StackBytes(void)
+{
+  uint32_t count = 0;
+
+  for (int i = 0; i <= indexLayerStack; ++i)
+  {
+    PluginLayer *pLayer = &pluginLayers[i];
+    count += PluginBytes(pLayer->plugin, pLayer->pPlugin, pluginTracks[pLayer->track].dspCount);
+  }
+
+  for (int i = 0; i <= indexTrackStack; ++i)
+    count += (pluginTracks[i].dspCount * pluginTracks[i].pixBytes);
+
+  return count;
+}
+
+// internal: recounts the memory used by all of the patterns after it has changed
+void PixelNutEngine::UpdateMemory(void)
+{
+  memUsed = StackBytes();
+
+  if (patternSlots != NULL) // the active pattern's slot isn't up to date
+  {
+    for (int i = 0; i < numPatternSlots; ++i)
+      if (i != activePatternSlot) memUsed += patternSlots[i].memBytes;
+  }
+
+  if (memUsed > memPeak) memPeak = memUsed;
+}
+
+uint32_t PixelNutEngine::getMemoryPeak(bool reset)
+{
+  uint32_t peak = memPeak;
+  if (reset) memPeak = memUsed;
+  return peak;
+}
+
+PixelNutEngine::Status PixelNutEngine::estimatePatternMemory(const char *cmdstr, uint32_t *pbytes)
+{
+  uint32_t bytes = 0, maxbytes = 0;
+  short numlayers = 0, numtracks = 0;
+  uint16_t segoffset = 0, segcount = numPixels;
+  Status status = Status_Success;
+
+  // only the commands that determine the effects and their sizes are used, as in 'execCmdStr()'
+  for (const char *p = cmdstr; (status == Status_Success) && *p; )
+  {
+    while (*p == ' ') ++p;
+    if (!*p) break;
+
+    char cmd = toupper(*p);
+    char *pval = (char*)(p+1); // not modified
+
+    if (cmd == 'J')
+    {
+      segoffset = ((uint32_t)GetNumValue(pval, 0, MAX_PERCENTAGE) * numPixels) / MAX_PERCENTAGE;
+      if (segoffset > (numPixels-1)) segoffset = (numPixels-1);
+    }
+    else if (cmd == 'K')
+    {
+      segcount = ((uint32_t)GetNumValue(pval, 0, MAX_PERCENTAGE) * numPixels) / MAX_PERCENTAGE;
+      if (segcount > (numPixels-segoffset)) segcount = (numPixels-segoffset);
+    }
+    else if (cmd == 'X')
+    {
+      int pos = GetNumValue(pval, numPixels-1);
+      segoffset = ((pos >= 0) ? pos : 0);
+    }
+    else if (cmd == 'Y')
+    {
+      int count = GetNumValue(pval, numPixels-segoffset);
+      segcount = ((count > 0) ? count : numPixels);
+    }
+    else if (cmd == 'P') // stack is cleared: previous effects are freed first
+    {
+      bytes = numlayers = numtracks = 0;
+    }
+    else if (cmd == 'E')
+    {
+      int plugin = GetNumValue(pval, MAX_PLUGIN_VALUE);
+      PixelNutPlugin *pPlugin = ((plugin >= 0) ? MakePlugin(plugin) : NULL);
+
+      if (pPlugin == NULL) status = Status_Error_BadVal;
+      else
+      {
+        bool newtrack = (pPlugin->gettype() & PLUGIN_TYPE_REDRAW);
+
+        if (++numlayers > maxPluginLayers) status = Status_Error_Memory;
+        else if (newtrack && (++numtracks > maxPluginTracks)) status = Status_Error_Memory;
+        else if (!numtracks) status = Status_Error_BadCmd; // first plugin must be a track
+
+        bytes += PluginBytes(plugin, pPlugin, segcount);
+        if (newtrack) bytes += (segcount * (pPlugin->intensityonly() ? 1 : 3));
+        if (bytes > maxbytes) maxbytes = bytes;
+
+        FreePlugin(pPlugin);
+      }
+    }
+
+    while (*p && (*p != ' ')) ++p; // skip to next command
+  }
+
+  DBGOUT((F("Estimate pattern: bytes=%lu status=%d"), maxbytes, status));
+  *pbytes = maxbytes;
+  return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Loop playback routines
+// While searching, the engine state after each frame is compared with a reference state, which is
+// replaced after 1,2,4,8... frames so that a loop is found even if the effects take a while to
+// start repeating, until the longest loop allowed has been searched for. The frames after the
+// reference state are recorded as the time since the previous frame, then pairs of (unchanged
+// bytes, changed bytes) until the end of the pixels, with the changed bytes XOR'ed with the
+// previous frame following each pair. All values are variable length, with
+// 7 bits in each byte, and the top bit set if more bytes follow.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t loopMsecs; // virtual clock used when catching up to where the playback left off
+static uint32_t LoopMsecs(void) { return loopMsecs; }
+
+// appends a value to the recording, returns false if there isn't room for it
+static bool PutLoopValue(byte *pbuff, uint32_t maxlen, uint32_t *poffset, uint32_t value)
+{
+  do
+  {
+    if (*poffset >= maxlen) return false;
+    pbuff[(*poffset)++] = ((value > 0x7F) ? ((value & 0x7F) | 0x80) : value);
+    value >>= 7;
+  }
+  while (value > 0);
+  return true;
+}
+
+static uint32_t GetLoopValue(byte *pbuff, uint32_t *poffset)
+{
+  uint32_t value = 0;
+  for (byte shift = 0; ; shift += 7)
+  {
+    byte b = pbuff[(*poffset)++];
+    value |= ((uint32_t)(b & 0x7F) << shift);
+    if (!(b & 0x80)) return value;
+  }
+}
+
+// internal: returns true if all effects are repeatable, and none are being triggered automatically
+bool PixelNutEngine::LoopRepeatable(void)
+{
+  for (int i = 0; i <= indexLayerStack; ++i)
+  {
+    if (pluginLayers[i].track > indexTrackEnable) break; // not enabled yet
+
+    if (pluginLayers[i].trigActive && pluginLayers[i].trigCount && (pluginLayers[i].trigTimeMsecs > 0))
+      return false;
+
+    if (!pluginLayers[i].pPlugin->repeatable()) return false;
+  }
+  return true;
+}
+
+// internal: saves the engine state into 'pbuff' (which has room for 'loopStateLen' bytes), followed
+// by when the next frame boundary is, if frame pacing is being used
+void PixelNutEngine::SaveLoopState(byte *pbuff, uint32_t time)
+{
+  uint32_t frametime = (msecsPerFrame ? (timeNextFrame - time) : 0);
+
+  saveState(pbuff, loopStateLen);
+  memcpy((pbuff + loopStateLen - sizeof(uint32_t)), &frametime, sizeof(uint32_t));
+}
+
+// internal: records the frame just drawn, and starts playing back if the effects have repeated
+void PixelNutEngine::RecordLoop(uint32_t time)
+{
+  if (!LoopRepeatable())
+  {
+    loopHaveRef = false; // must start over once they are
+    return;
+  }
+
+  uint32_t numbytes = numPixels*3;
+
+  if (loopHaveRef)
+  {
+    // record the changes from the previous frame
+    bool success = PutLoopValue(pLoopBuff, loopMaxBytes, &loopBytes, (time - loopTimePrev));
+    uint32_t i = 0;
+
+    while (success && (i < numbytes))
+    {
+      uint32_t start = i;
+      while ((i < numbytes) && (pDisplayPixels[i] == pLoopPixels[i])) ++i;
+      success = PutLoopValue(pLoopBuff, loopMaxBytes, &loopBytes, (i - start));
+
+      start = i;
+      while ((i < numbytes) && (pDisplayPixels[i] != pLoopPixels[i])) ++i;
+      if (success) success = PutLoopValue(pLoopBuff, loopMaxBytes, &loopBytes, (i - start));
+
+      if (success && ((loopBytes + (i - start)) > loopMaxBytes)) success = false;
+      for (; success && (start < i); ++start)
+        pLoopBuff[loopBytes++] = (pDisplayPixels[start] ^ pLoopPixels[start]);
+    }
+
+    if (!success)
+    {
+      DBGOUT((F("Loop doesn't fit: frames=%lu"), loopFrames));
+      loopState = LoopState_Failed;
+      return;
+    }
+
+    ++loopFrames;
+
+    // triggers waiting to be sent are not part of the saved state
+    if (!trigQueueCount && ((saveState(NULL, 0) + sizeof(uint32_t)) == loopStateLen))
+    {
+      byte *pcur = pLoopStates + loopStateLen;
+
+      // the pixel buffers are at the end of the state, and are much larger than the rest of it,
+      // so they're only saved and compared once everything before them is the same
+      uint32_t len = saveState(pcur, loopStateLen, false);
+      if (!memcmp(pLoopStates, pcur, len))
+      {
+        SaveLoopState(pcur, time);
+        if (!memcmp(pLoopStates, pcur, loopStateLen))
+        {
+          DBGOUT((F("Loop playback: frames=%lu bytes=%lu"), loopFrames, loopBytes));
+
+          loopOffset = 0;
+          loopPlayed = 0;
+          loopTimeStart = time;
+          loopTimeNext = time + GetLoopValue(pLoopBuff, &loopOffset);
+          loopState = LoopState_Playing;
+          return;
+        }
+      }
+    }
+  }
+
+  if (!loopHaveRef || (loopFrames >= loopPower)) // replace the reference state
+  {
+    if (loopHaveRef && loopMaxFrames && (loopPower >= loopMaxFrames))
+    {
+      DBGOUT((F("Loop not found: frames=%lu"), loopFrames));
+      loopState = LoopState_Failed;
+      return;
+    }
+
+    uint32_t len = saveState(NULL, 0) + sizeof(uint32_t);
+    if (len != loopStateLen)
+    {
+      DBGOUT((F("Loop state length: %lu bytes"), len));
+
+      free(pLoopStates);
+      pLoopStates = (byte*)malloc(len * 2);
+      if (pLoopStates == NULL)
+      {
+        DBGOUT((F("Cannot allocate loop states")));
+        loopStateLen = 0;
+        loopState = LoopState_Failed;
+        return;
+      }
+
+      loopStateLen = len;
+    }
+
+    loopPower = (loopHaveRef ? (loopPower * 2) : 1);
+    loopHaveRef = !trigQueueCount; // try again next frame if cannot compare with this one
+    loopFrames = 0;
+    loopBytes = 0;
+
+    SaveLoopState(pLoopStates, time);
+  }
+
+  memcpy(pLoopPixels, pDisplayPixels, numbytes);
+  loopTimePrev = time;
+}
+
+// internal: shows the next frame of the loop if it's time for it, returning true if so
+bool PixelNutEngine::PlayLoop(uint32_t time)
+{
+  if (time < loopTimeNext) return false;
+
+  uint32_t numbytes = numPixels*3;
+  uint32_t i = 0;
+
+  while (i < numbytes)
+  {
+    i += GetLoopValue(pLoopBuff, &loopOffset);
+
+    uint32_t count = GetLoopValue(pLoopBuff, &loopOffset);
+    while (count--) pDisplayPixels[i++] ^= pLoopBuff[loopOffset++];
+  }
+
+  if (loopOffset >= loopBytes) // back to the start of the loop
+  {
+    loopOffset = 0;
+    loopPlayed = 0;
+    loopTimeStart = time;
+  }
+  else ++loopPlayed;
+
+  loopTimeNext = time + GetLoopValue(pLoopBuff, &loopOffset);
+  timePrevUpdate = time;
+  return true;
+}
+
+// internal: called before anything can change the effects: if playing back a loop, the effects are
+// restored to the start of the loop, then advanced through the frames already played, using a
+// virtual clock, so that they continue on from the frame currently displayed
+void PixelNutEngine::StopLoop(void)
+{
+  if (loopState == LoopState_Disabled) return;
+
+  if (loopState == LoopState_Playing)
+  {
+    DBGOUT((F("Loop stopped: frames played=%lu"), loopPlayed));
+
+    loopState = LoopState_Disabled; // don't search while catching up
+
+    GetMsecsTime getmsecs = pixelNutSupport.getMsecs;
+    pixelNutSupport.getMsecs = LoopMsecs;
+    loopMsecs = loopTimeStart;
+
+    if (loadState(pLoopStates, (loopStateLen - sizeof(uint32_t))) == Status_Success)
+    {
+      uint32_t offset = 0;
+      uint32_t numbytes = numPixels*3;
+
+      for (uint32_t frame = 0; frame < loopPlayed; ++frame)
+      {
+        loopMsecs += GetLoopValue(pLoopBuff, &offset);
+
+        for (uint32_t i = 0; i < numbytes; ) // skip over the pixel changes
+        {
+          i += GetLoopValue(pLoopBuff, &offset);
+          uint32_t count = GetLoopValue(pLoopBuff, &offset);
+          offset += count;
+          i += count;
+        }
+
+        updateEffects();
+      }
+
+      // the pixels are already those of the start of the loop if no frames were played
+      if (!loopPlayed) timePrevUpdate = loopTimeStart;
+    }
+
+    pixelNutSupport.getMsecs = getmsecs;
+  }
+
+  loopState = LoopState_Searching;
+  loopHaveRef = false;
+}
+
+bool PixelNutEngine::setLoopPlayback(uint32_t maxbytes, uint16_t maxframes)
+{
+  DBGOUT((F("Loop playback: maxbytes=%lu maxframes=%u"), maxbytes, maxframes));
+
+  StopLoop();
+
+  free(pLoopBuff); // free(NULL) does nothing
+  free(pLoopPixels);
+  free(pLoopStates);
+
+  pLoopBuff = pLoopPixels = pLoopStates = NULL;
+  loopMaxBytes = loopStateLen = 0;
+  loopState = LoopState_Disabled;
+
+  if (!maxbytes) return true;
+
+  pLoopBuff = (byte*)malloc(maxbytes);
+  pLoopPixels = (byte*)malloc(numPixels*3);
+  if ((pLoopBuff == NULL) || (pLoopPixels == NULL))
+  {
+    free(pLoopBuff);
+    free(pLoopPixels);
+    pLoopBuff = pLoopPixels = NULL;
+    return false;
+  }
+
+  loopMaxBytes = maxbytes;
+  loopMaxFrames = maxframes;
+  loopState = LoopState_Searching;
+  loopHaveRef = false;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Changed pixel routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define RANGE_MERGE_GAP 1 // max unchanged pixels between changes kept in the same range
+
+// internal: finds the ranges of pixels that are different from the previous frame shown,
+// copying them as it goes, so that the pixels only need to be gone through once
+void PixelNutEngine::FindChanges(void)
+{
+  byte *pnew = pDisplayPixels;
+  byte *pold = pShownPixels;
+  PixelRange *prange = NULL;
+
+  numChangeRanges = 0;
+
+  for (uint16_t i = 0; i < numPixels; ++i, pnew += 3, pold += 3)
+  {
+    if (shownPixelsValid && (pnew[0] == pold[0]) && (pnew[1] == pold[1]) && (pnew[2] == pold[2]))
+      continue;
+
+    pold[0] = pnew[0];
+    pold[1] = pnew[1];
+    pold[2] = pnew[2];
+
+    if ((prange != NULL) && ((numChangeRanges >= maxChangeRanges) ||
+                             ((i - (prange->start + prange->count)) <= RANGE_MERGE_GAP)))
+      prange->count = (i - prange->start) + 1;
+    else
+    {
+      prange = &pChangeRanges[numChangeRanges++];
+      prange->start = i;
+      prange->count = 1;
+    }
+  }
+
+  shownPixelsValid = true;
+}
+
+bool PixelNutEngine::setChangedRanges(byte maxranges)
+{
+  DBGOUT((F("Changed ranges: max=%d"), maxranges));
+
+  free(pChangeRanges); // free(NULL) does nothing
+  free(pShownPixels);
+
+  pChangeRanges = NULL;
+  pShownPixels = NULL;
+  maxChangeRanges = numChangeRanges = 0;
+  shownPixelsValid = false;
+
+  if (!maxranges) return true;
+
+  pChangeRanges = (PixelRange*)malloc(maxranges * sizeof(PixelRange));
+  pShownPixels = (byte*)malloc(numPixels*3);
+  if ((pChangeRanges == NULL) || (pShownPixels == NULL))
+  {
+    free(pChangeRanges);
+    free(pShownPixels);
+    pChangeRanges = NULL;
+    pShownPixels = NULL;
+    return false;
+  }
+
+  maxChangeRanges = maxranges;
+  return true;
+}
+
+uint32_t PixelNutEngine::encodeChanges(byte *pbuff, uint32_t maxlen)
+{
+  uint32_t len = 2;
+  for (int i = 0; i < numChangeRanges; ++i)
+    len += 4 + (pChangeRanges[i].count * 3);
+
+  if (pbuff == NULL) return len;
+  if (len > maxlen) return 0;
+
+  *pbuff++ = (numChangeRanges & 0xFF);
+  *pbuff++ = 0;
+
+  for (int i = 0; i < numChangeRanges; ++i)
+  {
+    PixelRange *prange = &pChangeRanges[i];
+    *pbuff++ = (prange->start & 0xFF);
+    *pbuff++ = (prange->start >> 8);
+    *pbuff++ = (prange->count & 0xFF);
+    *pbuff++ = (prange->count >> 8);
+
+    memcpy(pbuff, (pDisplayPixels + (prange->start * 3)), (prange->count * 3));
+    pbuff += (prange->count * 3);
+  }
+
+  return len;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Additional output routines
+// Each display pixel is read once, then stored into every output that includes it, so that adding
+// outputs costs little more than the copies themselves.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// internal: copies the display pixels into all of the outputs, reordered and scaled for each one
+void PixelNutEngine::ShowOutputs(void)
+{
+  byte *p = pDisplayPixels;
+  for (uint16_t i = 0; i < numPixels; ++i, p += 3)
+  {
+    PixelOutput *pout = pOutputs;
+    for (byte j = 0; j < numOutputs; ++j, ++pout)
+    {
+      uint16_t k = i - pout->first; // wraps around if before the output's range
+      if (k >= pout->count) continue;
+
+      byte *pdst = pout->pPixels + ((uint32_t)(pout->goUpwards ? k : (pout->count-1 - k)) * 3);
+      if (pout->factor == MAX_BYTE_VALUE)
+      {
+        pdst[pout->index[0]] = p[0];
+        pdst[pout->index[1]] = p[1];
+        pdst[pout->index[2]] = p[2];
+      }
+      else // scaled by floor(v*factor/255), as for intensity only tracks
+      {
+        uint16_t v0 = p[0] * pout->factor;
+        uint16_t v1 = p[1] * pout->factor;
+        uint16_t v2 = p[2] * pout->factor;
+        pdst[pout->index[0]] = ((v0 + (v0 >> 8) + 1) >> 8);
+        pdst[pout->index[1]] = ((v1 + (v1 >> 8) + 1) >> 8);
+        pdst[pout->index[2]] = ((v2 + (v2 >> 8) + 1) >> 8);
+      }
+    }
+  }
+}
+
+bool PixelNutEngine::addOutput(byte *ptr_pixels, PixelValOrder *pix_order, byte pcent_bright,
+                               uint16_t first_pixel, uint16_t num_pixels, bool goupwards)
+{
+  DBGOUT((F("Add output #%d: first=%d count=%d"), numOutputs, first_pixel, num_pixels));
+
+  if ((ptr_pixels == NULL) || (first_pixel >= numPixels) || (numOutputs >= MAX_BYTE_VALUE))
+    return false;
+
+  if (!num_pixels || (num_pixels > (numPixels - first_pixel)))
+    num_pixels = numPixels - first_pixel;
+
+  PixelOutput *poutputs = (PixelOutput*)malloc((numOutputs+1) * sizeof(PixelOutput));
+  if (poutputs == NULL) return false;
+
+  if (pOutputs != NULL)
+  {
+    memcpy(poutputs, pOutputs, (numOutputs * sizeof(PixelOutput)));
+    free(pOutputs);
+  }
+  pOutputs = poutputs;
+
+  PixelOutput *pout = &pOutputs[numOutputs++];
+  pout->pPixels = ptr_pixels;
+  pout->first = first_pixel;
+  pout->count = num_pixels;
+  pout->goUpwards = goupwards;
+
+  // the display values are in the order given to PixelNutSupport
+  PixelValOrder *porder = pixelNutSupport.getPixelOrder();
+  pout->index[porder->r] = pix_order->r;
+  pout->index[porder->g] = pix_order->g;
+  pout->index[porder->b] = pix_order->b;
+
+  setOutputBrightness((numOutputs-1), pcent_bright);
+
+  timePrevUpdate = 0; // set the new output on the next update
+  return true;
+}
+
+void PixelNutEngine::setOutputBrightness(byte index, byte percent)
+{
+  if (index >= numOutputs) return;
+  if (percent > MAX_PERCENTAGE) percent = MAX_PERCENTAGE;
+
+  pOutputs[index].factor = (((uint16_t)percent * MAX_BYTE_VALUE) + (MAX_PERCENTAGE/2)) / MAX_PERCENTAGE;
+  timePrevUpdate = 0; // show it on the next update
+}
+
+void PixelNutEngine::clearOutputs(void)
+{
+  free(pOutputs); // free(NULL) does nothing
+  pOutputs = NULL;
+  numOutputs = 0;
+}
+
+#if (COMMAND_QUEUE_SIZE > 0)
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Command queue routines
+// A single producer adds calls at the tail, and the consumer (updateEffects) takes them from the
+// head. Each index is a single byte that only one side writes, so it's always read whole, and is
+// only advanced after the values it covers have been written/read, so no locks are needed.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define QUEUE_MASK (COMMAND_QUEUE_SIZE-1)
+
+#if defined(__AVR__) // single core: only the compiler must be kept from reordering
+#define QUEUE_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#else // the consumer may be on another core
+#define QUEUE_BARRIER() __sync_synchronize()
+#endif
+
+// internal: adds a call with 'len' values from 'pvals' (or the string 'pstr') to the queue
+bool PixelNutEngine::QueuePut(byte type, const byte *pvals, const char *pstr, byte len)
+{
+  byte tail = cmdQueueTail;
+  byte used = (byte)(tail - cmdQueueHead);
+  byte skip = 0;
+
+  // a command string is parsed where it is, so it can't wrap around the end of the queue
+  byte start = (byte)(tail + 2) & QUEUE_MASK;
+  if ((pstr != NULL) && (((uint16_t)start + len) > COMMAND_QUEUE_SIZE))
+    skip = COMMAND_QUEUE_SIZE - start;
+
+  if (((uint16_t)used + skip + len + 2) > QUEUE_MASK) // always leave one byte unused
+  {
+    ++queueDropped;
+    return false;
+  }
+
+  while (skip--) cmdQueue[tail++ & QUEUE_MASK] = QueueType_Skip;
+  cmdQueue[tail++ & QUEUE_MASK] = type;
+  cmdQueue[tail++ & QUEUE_MASK] = len;
+  if (pstr != NULL) pvals = (const byte*)pstr;
+  for (byte i = 0; i < len; ++i)
+    cmdQueue[tail++ & QUEUE_MASK] = pvals[i];
+
+  QUEUE_BARRIER(); // values must be there before the consumer can see them
+  cmdQueueTail = tail;
+  return true;
+}
+
+bool PixelNutEngine::queueCmdStr(const char *cmdstr)
+{
+  size_t len = strlen(cmdstr) + 1; // with the terminator
+  if (len > (QUEUE_MASK-2))
+  {
+    ++queueDropped;
+    return false;
+  }
+  return QueuePut(QueueType_CmdStr, NULL, cmdstr, len);
+}
+
+bool PixelNutEngine::queueColorProperty(short hue_degree, byte white_percent)
+{
+  byte vals[3] = { (byte)(hue_degree & 0xFF), (byte)(hue_degree >> 8), white_percent };
+  return QueuePut(QueueType_Color, vals, NULL, sizeof(vals));
+}
+
+bool PixelNutEngine::queueCountProperty(byte pixcount_percent)
+{
+  return QueuePut(QueueType_Count, &pixcount_percent, NULL, 1);
+}
+
+bool PixelNutEngine::queueTriggerForce(short force, uint32_t msecs)
+{
+  byte vals[6] = { (byte)(force & 0xFF), (byte)(force >> 8),
+                   (byte)(msecs & 0xFF), (byte)(msecs >> 8), (byte)(msecs >> 16), (byte)(msecs >> 24) };
+  return QueuePut(QueueType_Force, vals, NULL, sizeof(vals));
+}
+
+// internal: returns the time of the trigger at 'index' in the queue
+static uint32_t QueueForceTime(byte *pqueue, byte index)
+{
+  uint32_t msecs = 0;
+  for (int i = 3; i >= 0; --i)
+    msecs = (msecs << 8) | pqueue[(byte)(index + 4 + i) & QUEUE_MASK];
+  return msecs;
+}
+
+// internal: returns true if there's a call in the queue that can be made at 'time',
+// otherwise sets 'pnext' to the time of the trigger waiting at the head (if any)
+bool PixelNutEngine::QueueWaiting(uint32_t time, uint32_t *pnext)
+{
+  byte head = cmdQueueHead;
+  if (head == cmdQueueTail) return false;
+  QUEUE_BARRIER();
+
+  if (cmdQueue[head & QUEUE_MASK] != QueueType_Force) return true;
+
+  uint32_t msecs = QueueForceTime(cmdQueue, head);
+  if (!msecs || ((int32_t)(msecs - time) <= 0)) return true;
+
+  if (!*pnext || (msecs < *pnext)) *pnext = msecs;
+  return false;
+}
+
+// internal: makes the calls in the queue, in order, up to any trigger that isn't due yet
+void PixelNutEngine::QueueDrain(uint32_t time)
+{
+  byte head = cmdQueueHead;
+  byte tail = cmdQueueTail;
+  QUEUE_BARRIER(); // values are read only after the producer's index
+
+  while (head != tail)
+  {
+    byte type = cmdQueue[head & QUEUE_MASK];
+    if (type == QueueType_Skip) // unused bytes before a command string
+    {
+      cmdQueueHead = ++head;
+      continue;
+    }
+
+    byte len = cmdQueue[(byte)(head+1) & QUEUE_MASK];
+    byte start = head + 2;
+
+    // values are used where they are: the head is only moved past them afterwards
+    switch (type)
+    {
+      case QueueType_CmdStr:
+      {
+        // the string is contiguous, and the producer can't write it until the head moves
+        Status status = execCmdStr((char*)&cmdQueue[start & QUEUE_MASK]);
+        if (status != Status_Success) queueStatus = status;
+        DBGOUT((F("Queued command: status=%d"), status));
+        break;
+      }
+      case QueueType_Color:
+      {
+        short hue = (short)(cmdQueue[start & QUEUE_MASK] | (cmdQueue[(byte)(start+1) & QUEUE_MASK] << 8));
+        setColorProperty(hue, cmdQueue[(byte)(start+2) & QUEUE_MASK]);
+        break;
+      }
+      case QueueType_Count:
+      {
+        setCountProperty(cmdQueue[start & QUEUE_MASK]);
+        break;
+      }
+      case QueueType_Force:
+      {
+        uint32_t msecs = QueueForceTime(cmdQueue, head);
+        if (msecs && ((int32_t)(msecs - time) > 0)) return; // not yet, and all others wait on it
+
+        triggerForce((short)(cmdQueue[start & QUEUE_MASK] | (cmdQueue[(byte)(start+1) & QUEUE_MASK] << 8)));
+        break;
+      }
+    }
+
+    head = start + len;
+    QUEUE_BARRIER(); // values are used before the producer can overwrite them
+    cmdQueueHead = head;
+  }
+}
+#endif
@@ -1,3 +1,6 @@
 #include "includes/PixelNutSupport.h"   // engine support interface and standard types
 #include "includes/PixelNutPlugin.h"    // template for all plugins (abstract class)
 #include "includes/PixelNutEngine.h"    // main header file for pixelnut engine
+#include "includes/PixelNutPackets.h"   // optional: packets for sending pixels over a network
+#include "includes/PluginRegistry.h"    // optional: factory of only the plugins that are listed
+#include "includes/PixelNutStatic.h"    // optional: engine with everything in static memory
@@ -0,0 +1,204 @@
+// PixelNut Packets Class Implementation
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#include <PixelNutLib.h>
+
+#define DEBUG_OUTPUT 0 // 1 to debug this file
+#if DEBUG_OUTPUT
+#define DBG(x) x
+#define DBGOUT(x) pixelNutSupport.msgFormat x
+#else
+#define DBG(x)
+#define DBGOUT(x)
+#endif
+
+// offsets of values in the E1.31 header (all values are most significant byte first)
+#define E131_ROOT_LENGTH      16        // flags and length of root layer
+#define E131_FRAME_LENGTH     38        // flags and length of framing layer
+#define E131_SEQUENCE         111       // sequence number
+#define E131_DMP_LENGTH       115       // flags and length of DMP layer
+
+// DDP header values
+#define DDP_FLAGS_VER1        0x40      // version 1
+#define DDP_FLAGS_PUSH        0x01      // display the data received
+#define DDP_TYPE_RGB24        0x0B      // RGB, 8 bits per value
+#define DDP_ID_DISPLAY        1         // default output device
+
+static void PutWord(byte *p, uint16_t value)
+{
+  p[0] = (value >> 8);
+  p[1] = (value & 0xFF);
+}
+
+static void PutLong(byte *p, uint32_t value)
+{
+  PutWord(p, (value >> 16));
+  PutWord((p+2), (value & 0xFFFF));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor/destructor: allocates all the packets, and fills in their headers
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PixelNutPackets::PixelNutPackets(Protocol protocol, uint16_t num_pixels, uint16_t first_universe,
+                                 const char *name, const byte *cid)
+{
+  this->protocol = protocol;
+  numPixels = num_pixels;
+  numSend = 0;
+  sequence = 1;
+
+  if (protocol == Protocol_E131)
+  {
+    packetPixels = E131_UNIVERSE_PIXELS;
+    headerBytes = E131_HEADER_BYTES;
+  }
+  else
+  {
+    packetPixels = DDP_PACKET_PIXELS;
+    headerBytes = DDP_HEADER_BYTES;
+  }
+
+  numPackets = (num_pixels + packetPixels - 1) / packetPixels;
+  packetBytes = headerBytes + (packetPixels * 3);
+
+  pPackets = (byte*)malloc((uint32_t)numPackets * packetBytes);
+  pSendIndex = (uint16_t*)malloc(numPackets * sizeof(uint16_t));
+
+  if ((pPackets == NULL) || (pSendIndex == NULL) || !numPackets ||
+      ((protocol == Protocol_E131) && (((uint32_t)first_universe + numPackets) > 64000)))
+  {
+    free(pPackets);
+    free(pSendIndex);
+    pPackets = NULL; // caller must test for this
+    pSendIndex = NULL;
+    return;
+  }
+
+  memset(pPackets, 0, ((uint32_t)numPackets * packetBytes));
+
+  for (uint16_t i = 0; i < numPackets; ++i)
+  {
+    byte *packet = pPackets + ((uint32_t)i * packetBytes);
+    uint16_t pixcount = ((i < numPackets-1) ? packetPixels : (num_pixels - (i * packetPixels)));
+
+    if (protocol == Protocol_E131) InitE131(packet, (first_universe + i), pixcount, name, cid);
+    else InitDDP(packet, ((uint32_t)i * packetPixels * 3), pixcount);
+  }
+
+  DBGOUT((F("Packets: protocol=%d pixels=%d packets=%d"), protocol, num_pixels, numPackets));
+}
+
+PixelNutPackets::~PixelNutPackets()
+{
+  free(pPackets);
+  free(pSendIndex);
+}
+
+// fills in the E1.31 header for a universe with 'pixcount' pixels (which never changes)
+void PixelNutPackets::InitE131(byte *packet, uint16_t universe, uint16_t pixcount, const char *name, const byte *cid)
+{
+  uint16_t length = E131_HEADER_BYTES + (pixcount * 3);
+
+  // root layer
+  PutWord(packet, 0x0010);                            // preamble size
+  memcpy((packet+4), "ASC-E1.17", 9);                 // packet identifier (zero padded)
+  PutWord((packet + E131_ROOT_LENGTH), (0x7000 | (length - E131_ROOT_LENGTH)));
+  PutLong((packet+18), 0x00000004);                   // data packet
+  if (cid != NULL) memcpy((packet+22), cid, 16);
+
+  // framing layer
+  PutWord((packet + E131_FRAME_LENGTH), (0x7000 | (length - E131_FRAME_LENGTH)));
+  PutLong((packet+40), 0x00000002);                   // data packet
+  if (name != NULL) strncpy((char*)(packet+44), name, 63);
+  packet[108] = 100;                                  // default priority
+  PutWord((packet+113), universe);
+
+  // DMP layer
+  PutWord((packet + E131_DMP_LENGTH), (0x7000 | (length - E131_DMP_LENGTH)));
+  packet[117] = 0x02;                                 // set property
+  packet[118] = 0xA1;                                 // address and data type
+  PutWord((packet+121), 0x0001);                      // address increment
+  PutWord((packet+123), (1 + (pixcount * 3)));        // start code plus values
+}
+
+// fills in the DDP header for the pixels at byte 'offset' (the flags/sequence are set when sent)
+void PixelNutPackets::InitDDP(byte *packet, uint32_t offset, uint16_t pixcount)
+{
+  packet[2] = DDP_TYPE_RGB24;
+  packet[3] = DDP_ID_DISPLAY;
+  PutLong((packet+4), offset);
+  PutWord((packet+8), (pixcount * 3));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Packet creation: the pixels are compared with those already in each packet as they're copied,
+// so that the changed packets are found without going through the pixels more than once
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint16_t PixelNutPackets::makePackets(const byte *pixels, bool sendall)
+{
+  numSend = 0;
+  if (pPackets == NULL) return 0;
+
+  for (uint16_t i = 0; i < numPackets; ++i)
+  {
+    byte *packet = pPackets + ((uint32_t)i * packetBytes);
+    byte *pvals = packet + headerBytes;
+    uint16_t count = ((i < numPackets-1) ? packetPixels : (numPixels - (i * packetPixels))) * 3;
+
+    // the first packet made is always sent (sequence numbers start at 0)
+    bool changed = sendall || ((protocol == Protocol_E131) ? !packet[E131_SEQUENCE] : !packet[0]);
+
+    if (changed) memcpy(pvals, pixels, count);
+    else for (uint16_t j = 0; j < count; ++j)
+    {
+      if (pvals[j] != pixels[j])
+      {
+        memcpy((pvals+j), (pixels+j), (count-j));
+        changed = true;
+        break;
+      }
+    }
+
+    if (changed)
+    {
+      if (protocol == Protocol_E131)
+      {
+        if (!++packet[E131_SEQUENCE]) packet[E131_SEQUENCE] = 1; // 0 only until first sent
+      }
+      else
+      {
+        packet[0] = DDP_FLAGS_VER1;
+        packet[1] = sequence;
+        if (++sequence > 15) sequence = 1; // 4 bits, and 0 is not used
+      }
+
+      pSendIndex[numSend++] = i;
+    }
+
+    pixels += count;
+  }
+
+  // DDP receivers wait for the push flag before displaying the pixels
+  if ((protocol == Protocol_DDP) && numSend)
+    pPackets[(uint32_t)pSendIndex[numSend-1] * packetBytes] |= DDP_FLAGS_PUSH;
+
+  DBGOUT((F("Packets: sending %d of %d"), numSend, numPackets));
+  return numSend;
+}
+
+byte *PixelNutPackets::getPacket(uint16_t index, uint16_t *plen)
+{
+  if (index >= numSend) return NULL;
+
+  uint16_t i = pSendIndex[index];
+  uint16_t count = ((i < numPackets-1) ? packetPixels : (numPixels - (i * packetPixels)));
+
+  *plen = headerBytes + (count * 3);
+  return pPackets + ((uint32_t)i * packetBytes);
+}
@@ -34,6 +34,28 @@ static PROGMEM const byte gamma_vals[] =
 
 static byte GammaCorrection(byte inval) { return pgm_read_byte(&gamma_vals[inval]); }
 
+// one full cosine wave as (cos+1)/2 scaled to 0-65535, with an extra entry to interpolate the last
+static PROGMEM const uint16_t wave_vals[] =
+{
+  65535, 65525, 65496, 65446, 65377, 65289, 65180, 65053, 64905, 64739, 64553, 64348, 64124, 63881, 63620, 63339, // 0x00-0x0F
+  63041, 62724, 62389, 62036, 61666, 61278, 60873, 60451, 60013, 59558, 59087, 58600, 58097, 57579, 57047, 56499, // 0x10-0x1F
+  55938, 55362, 54773, 54170, 53555, 52927, 52287, 51635, 50972, 50298, 49613, 48919, 48214, 47500, 46777, 46046, // 0x20-0x2F
+  45307, 44560, 43807, 43046, 42279, 41507, 40729, 39947, 39160, 38369, 37575, 36779, 35979, 35178, 34375, 33572, // 0x30-0x3F
+  32768, 31963, 31160, 30357, 29556, 28756, 27960, 27166, 26375, 25588, 24806, 24028, 23256, 22489, 21728, 20975, // 0x40-0x4F
+  20228, 19489, 18758, 18035, 17321, 16616, 15922, 15237, 14563, 13900, 13248, 12608, 11980, 11365, 10762, 10173, // 0x50-0x5F
+   9597,  9036,  8488,  7956,  7438,  6935,  6448,  5977,  5522,  5084,  4662,  4257,  3869,  3499,  3146,  2811, // 0x60-0x6F
+   2494,  2196,  1915,  1654,  1411,  1187,   982,   796,   630,   482,   355,   246,   158,    89,    39,    10, // 0x70-0x7F
+      0,    10,    39,    89,   158,   246,   355,   482,   630,   796,   982,  1187,  1411,  1654,  1915,  2196, // 0x80-0x8F
+   2494,  2811,  3146,  3499,  3869,  4257,  4662,  5084,  5522,  5977,  6448,  6935,  7438,  7956,  8488,  9036, // 0x90-0x9F
+   9597, 10173, 10762, 11365, 11980, 12608, 13248, 13900, 14563, 15237, 15922, 16616, 17321, 18035, 18758, 19489, // 0xA0-0xAF
+  20228, 20975, 21728, 22489, 23256, 24028, 24806, 25588, 26375, 27166, 27960, 28756, 29556, 30357, 31160, 31963, // 0xB0-0xBF
+  32767, 33572, 34375, 35178, 35979, 36779, 37575, 38369, 39160, 39947, 40729, 41507, 42279, 43046, 43807, 44560, // 0xC0-0xCF
+  45307, 46046, 46777, 47500, 48214, 48919, 49613, 50298, 50972, 51635, 52287, 52927, 53555, 54170, 54773, 55362, // 0xD0-0xDF
+  55938, 56499, 57047, 57579, 58097, 58600, 59087, 59558, 60013, 60451, 60873, 61278, 61666, 62036, 62389, 62724, // 0xE0-0xEF
+  63041, 63339, 63620, 63881, 64124, 64348, 64553, 64739, 64905, 65053, 65180, 65289, 65377, 65446, 65496, 65525, // 0xF0-0xFF
+  65535   // 0x100 (same as 0x00)
+};
+
 // hue: 0...MAX_DEGREES_HUE
 // sat: 0...MAX_PERCENTAGE
 // val: 0...MAX_BYTE_VALUE
@@ -108,6 +130,20 @@ static void MsgFormat(const __FlashStringHelper *str, ...) {}
 
 static PixelValOrder *pPixOrder;
 
+#if (COLOR_CACHE_SIZE > 0)
+typedef struct ATTR_PACKED // 7 bytes
+{
+  uint16_t hue;                 // hue of this color (MAX_WORD_VALUE if not used yet)
+  byte white, bright;           // whiteness and brightness percentages of this color
+  byte r,g,b;                   // RGB values created from those
+}
+ColorCacheEntry;
+
+static ColorCacheEntry colorCache[COLOR_CACHE_SIZE];
+#endif
+
+static uint32_t colorCacheHits, colorCacheMisses;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Public interface routines
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -117,13 +153,76 @@ PixelNutSupport::PixelNutSupport(GetMsecsTime get_msecs, PixelValOrder *pix_orde
   pPixOrder = pix_order;  // sets ordering of pixel RGB
   getMsecs = get_msecs;   // sets routine to get time
   msgFormat = MsgFormat;  // default is no debug output
+
+  #if (COLOR_CACHE_SIZE > 0)
+  for (int i = 0; i < COLOR_CACHE_SIZE; ++i)
+    colorCache[i].hue = MAX_WORD_VALUE;
+  #endif
 }
 
 void PixelNutSupport::makeColorVals(DrawProps *pdraw)
 {
+  #if (COLOR_CACHE_SIZE > 0)
+  // each color can only be in one place, with nearby hues in different places
+  int index = ((pdraw->degreeHue * 3) + (pdraw->pcentWhite * 5) + (pdraw->pcentBright * 7));
+  ColorCacheEntry *pentry = &colorCache[index & (COLOR_CACHE_SIZE-1)];
+
+  if ((pentry->hue == pdraw->degreeHue) &&
+      (pentry->white == pdraw->pcentWhite) &&
+      (pentry->bright == pdraw->pcentBright))
+  {
+    pdraw->r = pentry->r;
+    pdraw->g = pentry->g;
+    pdraw->b = pentry->b;
+    ++colorCacheHits;
+    return;
+  }
+  #endif
+
   // convert brightness value from percentage to a byte value
   byte brightval = ((uint32_t)pdraw->pcentBright * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
   HSVtoRGB(pdraw->degreeHue, (MAX_PERCENTAGE - pdraw->pcentWhite), brightval, &pdraw->r, &pdraw->g, &pdraw->b);
+  ++colorCacheMisses;
+
+  #if (COLOR_CACHE_SIZE > 0)
+  pentry->hue    = pdraw->degreeHue;
+  pentry->white  = pdraw->pcentWhite;
+  pentry->bright = pdraw->pcentBright;
+  pentry->r = pdraw->r;
+  pentry->g = pdraw->g;
+  pentry->b = pdraw->b;
+  #endif
+}
+
+void PixelNutSupport::colorCacheStats(uint32_t *phits, uint32_t *pmisses, bool reset)
+{
+  *phits = colorCacheHits;
+  *pmisses = colorCacheMisses;
+  if (reset) colorCacheHits = colorCacheMisses = 0;
+}
+
+// returns the address of a pixel in the drawing buffer, from where the pixels have been scrolled to
+static byte *PixelAddr(PixelNutEngine *pEngine, uint16_t pos)
+{
+  if (pEngine->drawOffset)
+  {
+    uint32_t bufpos = (uint32_t)pos + pEngine->drawOffset;
+    if (bufpos >= pEngine->drawLength) bufpos -= pEngine->drawLength;
+    return (pEngine->pDrawPixels + (bufpos * pEngine->drawPixBytes));
+  }
+  return (pEngine->pDrawPixels + (pos * pEngine->drawPixBytes));
+}
+
+// returns how many of 'count' pixels from 'pos' are next to each other in the drawing buffer
+static uint16_t PixelSpan(PixelNutEngine *pEngine, uint16_t pos, uint16_t count)
+{
+  if (pEngine->drawOffset)
+  {
+    uint32_t bufpos = (uint32_t)pos + pEngine->drawOffset;
+    if (bufpos >= pEngine->drawLength) bufpos -= pEngine->drawLength;
+    if ((bufpos + count) > pEngine->drawLength) return (pEngine->drawLength - bufpos);
+  }
+  return count;
 }
 
 void PixelNutSupport::movePixels(PixelNutHandle handle, uint16_t startpos, uint16_t endpos, uint16_t newpos)
@@ -131,10 +230,22 @@ void PixelNutSupport::movePixels(PixelNutHandle handle, uint16_t startpos, uint1
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs1 = (pEngine->pDrawPixels + (startpos * 3));
-    byte *ppixs2 = (pEngine->pDrawPixels + (newpos * 3));
-    int count = (endpos - startpos + 1) * 3;
-    memmove(ppixs2, ppixs1, count); 
+    int count = (endpos - startpos + 1);
+    byte pixbytes = pEngine->drawPixBytes;
+
+    if (!pEngine->drawOffset)
+    {
+      byte *ppixs1 = (pEngine->pDrawPixels + (startpos * pixbytes));
+      byte *ppixs2 = (pEngine->pDrawPixels + (newpos * pixbytes));
+      memmove(ppixs2, ppixs1, (count * pixbytes));
+    }
+    else if (newpos > startpos) // scrolled: move each pixel, starting from the end
+    {
+      for (int i = count-1; i >= 0; --i)
+        memcpy(PixelAddr(pEngine, (newpos + i)), PixelAddr(pEngine, (startpos + i)), pixbytes);
+    }
+    else for (int i = 0; i < count; ++i)
+        memcpy(PixelAddr(pEngine, (newpos + i)), PixelAddr(pEngine, (startpos + i)), pixbytes);
   }
 }
 
@@ -143,9 +254,26 @@ void PixelNutSupport::clearPixels(PixelNutHandle handle, uint16_t startpos, uint
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs = (pEngine->pDrawPixels + (startpos * 3));
-    int count = (endpos - startpos + 1) * 3;
-    memset(ppixs, 0, count);
+    uint16_t count = (endpos - startpos + 1);
+    while (count > 0) // at most twice if scrolled
+    {
+      uint16_t span = PixelSpan(pEngine, startpos, count);
+      memset(PixelAddr(pEngine, startpos), 0, (span * pEngine->drawPixBytes));
+      startpos += span;
+      count -= span;
+    }
+  }
+}
+
+void PixelNutSupport::scrollPixels(PixelNutHandle handle, short count)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if ((pEngine->pDrawPixels != NULL) && pEngine->drawLength)
+  {
+    // pixel at 'pos' is now the one that was at 'pos-count'
+    int32_t offset = ((int32_t)pEngine->drawOffset - count) % (int32_t)pEngine->drawLength;
+    if (offset < 0) offset += pEngine->drawLength;
+    pEngine->drawOffset = offset;
   }
 }
 
@@ -154,7 +282,12 @@ void PixelNutSupport::getPixel(PixelNutHandle handle, uint16_t pos, byte *ptr_r,
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs = (pEngine->pDrawPixels + (pos * 3));
+    byte *ppixs = PixelAddr(pEngine, pos);
+    if (pEngine->drawPixBytes == 1) // intensity only
+    {
+      *ptr_r = *ptr_g = *ptr_b = ppixs[0];
+      return;
+    }
     *ptr_r = ppixs[pPixOrder->r];
     *ptr_g = ppixs[pPixOrder->g];
     *ptr_b = ppixs[pPixOrder->b];
@@ -166,9 +299,16 @@ void PixelNutSupport::setPixel(PixelNutHandle handle, uint16_t pos, byte r, byte
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs = (pEngine->pDrawPixels + (pos * 3));
+    byte *ppixs = PixelAddr(pEngine, pos);
 
     byte brightval = (scale * pEngine->getMaxBrightness() * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
+
+    if (pEngine->drawPixBytes == 1) // intensity only: colored with the track color when shown
+    {
+      ppixs[0] = ((r | g | b) ? GammaCorrection(brightval) : 0);
+      return;
+    }
+
     float factor = ((float)GammaCorrection(brightval) / MAX_BYTE_VALUE);
 
     ppixs[pPixOrder->r] = r * factor;
@@ -182,7 +322,13 @@ void PixelNutSupport::setPixel(PixelNutHandle handle, uint16_t pos, float scale)
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs = (pEngine->pDrawPixels + (pos * 3));
+    byte *ppixs = PixelAddr(pEngine, pos);
+
+    if (pEngine->drawPixBytes == 1) // intensity only
+    {
+      ppixs[0] *= scale;
+      return;
+    }
 
     ppixs[pPixOrder->r] *= scale;
     ppixs[pPixOrder->g] *= scale;
@@ -190,6 +336,139 @@ void PixelNutSupport::setPixel(PixelNutHandle handle, uint16_t pos, float scale)
   }
 }
 
+byte PixelNutSupport::makeBrightFactor(PixelNutHandle handle, float scale)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  byte brightval = (scale * pEngine->getMaxBrightness() * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
+  return GammaCorrection(brightval);
+}
+
+void PixelNutSupport::setPixelRamp(PixelNutHandle handle, uint16_t pos, uint16_t count, uint16_t pixlen,
+                                   byte r, byte g, byte b, byte *pfactors)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if (pEngine->pDrawPixels == NULL) return;
+
+  byte ro = pPixOrder->r;
+  byte go = pPixOrder->g;
+  byte bo = pPixOrder->b;
+  bool intensity = (pEngine->drawPixBytes == 1);
+
+  while (count > 0) // at most twice: down to the start, then down from the end
+  {
+    uint16_t span = ((count > pos) ? (pos + 1) : count);
+    uint16_t start = (pos - span + 1);
+    count -= span;
+
+    // factors go down from 'pos', so start at the other end of the span
+    byte *pf = (pfactors + span - 1);
+    pfactors += span;
+
+    while (span > 0) // split again if the pixels have been scrolled
+    {
+      uint16_t bufspan = PixelSpan(pEngine, start, span);
+      byte *ppixs = PixelAddr(pEngine, start);
+      start += bufspan;
+      span -= bufspan;
+
+      if (intensity) // the factors are the intensities
+      {
+        for (; bufspan > 0; --bufspan, --pf) *ppixs++ = *pf;
+        continue;
+      }
+
+      for (; bufspan > 0; --bufspan, --pf, ppixs += 3)
+      {
+        uint16_t factor = *pf;
+        ppixs[ro] = (r * factor) / MAX_BYTE_VALUE;
+        ppixs[go] = (g * factor) / MAX_BYTE_VALUE;
+        ppixs[bo] = (b * factor) / MAX_BYTE_VALUE;
+      }
+    }
+
+    pos = pixlen-1;
+  }
+}
+
+void PixelNutSupport::makePixelVals(byte r, byte g, byte b, byte *pfactors, uint16_t count, byte *pvals)
+{
+  for (; count > 0; --count, pvals += 3)
+  {
+    uint16_t factor = *pfactors++;
+    pvals[pPixOrder->r] = (r * factor) / MAX_BYTE_VALUE;
+    pvals[pPixOrder->g] = (g * factor) / MAX_BYTE_VALUE;
+    pvals[pPixOrder->b] = (b * factor) / MAX_BYTE_VALUE;
+  }
+}
+
+void PixelNutSupport::setPixelVals(PixelNutHandle handle, uint16_t pos, uint16_t count, byte *plevels, byte *pvals)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if (pEngine->pDrawPixels == NULL) return;
+
+  while (count > 0) // at most twice if scrolled
+  {
+    uint16_t span = PixelSpan(pEngine, pos, count);
+    byte *ppixs = PixelAddr(pEngine, pos);
+    pos += span;
+    count -= span;
+
+    if (pEngine->drawPixBytes == 1) // intensity only: one value for each level
+    {
+      for (; span > 0; --span) *ppixs++ = pvals[*plevels++];
+      continue;
+    }
+
+    for (; span > 0; --span, ppixs += 3)
+    {
+      byte *pv = (pvals + (*plevels++ * 3)); // already in pixel order
+      ppixs[0] = pv[0];
+      ppixs[1] = pv[1];
+      ppixs[2] = pv[2];
+    }
+  }
+}
+
+PixelValOrder *PixelNutSupport::getPixelOrder(void)
+{
+  return pPixOrder;
+}
+
+byte PixelNutSupport::gammaCorrect(byte value)
+{
+  return GammaCorrection(value);
+}
+
+uint32_t PixelNutSupport::waveValue(uint32_t phase)
+{
+  byte index = (phase >> 24);
+  uint16_t frac = ((phase >> 8) & 0xFFFF); // distance to next entry
+
+  // values are kept in 1/256 units, so that they're never rounded
+  int32_t val = pgm_read_word(&wave_vals[index]);
+  int32_t next = pgm_read_word(&wave_vals[index+1]);
+  val = (val << 8) + (((next - val) * (int32_t)frac) >> 8);
+
+  // the curve is above/below the straight line between entries by up to 2.5, in proportion to
+  // its distance from the center: (val-32767.5) * frac*(1-frac) * (2*PI/256)^2/2, where the
+  // multiplier 20213 is (2*PI/256)^2/2 * 2^26, and the bend is reduced to 16 bits to fit
+  uint32_t fq = ((uint32_t)frac * (65536 - frac)) >> 16;
+  int32_t bend = (((val >> 7) - 65535) * (int32_t)fq) >> 14;
+  val += ((bend * 20213) >> 21);
+
+  if (val < 0) return 0;
+  if (val > 0xFFFF00) return 0xFFFF00;
+  return val;
+}
+
+uint32_t PixelNutSupport::stepsElapsed(PixelNutHandle handle, DrawProps *pdraw, uint16_t msecs)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  short delay = pdraw->msecsDelay + pEngine->getDelayOffset();
+  if (delay <= 0) delay = 1; // engine always advances by at least 1 each time
+  return (((uint32_t)msecs << 8) / delay);
+}
+
 long PixelNutSupport::mapValue(long inval, long in_min, long in_max, long out_min, long out_max)
 {
   return ((inval - in_min) * (out_max - out_min) / (in_max - in_min)) + out_min;
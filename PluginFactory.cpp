@@ -85,5 +85,36 @@ PixelNutPlugin *PluginFactory::makePlugin(int plugin)
   }
 }
 
-// must provide destructor for plugin abstract (interface) base class
-PixelNutPlugin::~PixelNutPlugin() {}
+// returns the size of the object for 'plugin' (not including any memory it allocates itself)
+uint16_t PluginFactory::sizePlugin(int plugin)
+{
+  switch (plugin)
+  {
+    case 0:   return sizeof(PNP_DrawAll);
+    case 1:   return sizeof(PNP_DrawPush);
+    case 2:   return sizeof(PNP_DrawStep);
+    case 10:  return sizeof(PNP_LightWave);
+    case 20:  return sizeof(PNP_CometHeads);
+    case 30:  return sizeof(PNP_FerrisWheel);
+    case 40:  return sizeof(PNP_BlockScanner);
+    case 50:  return sizeof(PNP_Twinkle);
+    case 51:  return sizeof(PNP_Blinky);
+    case 52:  return sizeof(PNP_Noise);
+    case 100: return sizeof(PNP_HueSet);
+    case 101: return sizeof(PNP_HueRotate);
+    case 110: return sizeof(PNP_ColorMeld);
+    case 111: return sizeof(PNP_ColorModify);
+    case 112: return sizeof(PNP_ColorRandom);
+    case 120: return sizeof(PNP_CountSet);
+    case 121: return sizeof(PNP_CountSurge);
+    case 122: return sizeof(PNP_CountWave);
+    case 130: return sizeof(PNP_DelaySet);
+    case 131: return sizeof(PNP_DelaySurge);
+    case 132: return sizeof(PNP_DelayWave);
+    case 141: return sizeof(PNP_BrightSurge);
+    case 142: return sizeof(PNP_BrightWave);
+    case 150: return sizeof(PNP_WinExpander);
+    case 160: return sizeof(PNP_FlipDirection);
+    default:  return 0;
+  }
+}
@@ -0,0 +1,20 @@
+// Preset made by 'pnpreset' (extras/hosttools): do not edit, make it again instead.
+// Pattern on 60 pixels: E10 B50 D60 T E101 T E120 F250 T G
+
+#define MYPRESET_PIXELS 60
+#define MYPRESET_LAYERS 3
+#define MYPRESET_TRACKS 1
+
+#define MYPRESET_PATTERN "E10 B50 D60 T E101 T E120 F250 T G"
+
+PROGMEM const byte myPreset[136] = {
+  0x05, 0x12, 0x1F, 0x03, 0x01, 0x01, 0x3C, 0x00, 0x64, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x3C,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3B, 0x00, 0x0F, 0x00,
+  0x00, 0x00, 0x00, 0x32, 0x24, 0x00, 0x00, 0x3C, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01, 0x3C,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x01, 0x00, 0x00, 0x00, 0xF4,
+  0x01, 0x01, 0x00, 0xFF, 0x00, 0x0A, 0x00, 0x07, 0x00, 0x00, 0x3C, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x01, 0x00, 0x00, 0x00, 0xF4, 0x01, 0x01, 0x00, 0xFF, 0x00,
+  0x65, 0x00, 0x0E, 0x00, 0x00, 0x00, 0x3C, 0x00, 0x00, 0x00, 0x77, 0x77, 0x3F, 0x40, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x01, 0x00, 0x00, 0x00, 0xFA, 0x00, 0x01, 0x00,
+  0xFF, 0x00, 0x78, 0x00, 0x02, 0x00, 0x3C, 0x00
+};
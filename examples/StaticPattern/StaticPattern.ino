@@ -0,0 +1,65 @@
+// PixelNut! Example Application
+//
+// Copyright(c) 2017, Greg de Valois, www.devicenut.com
+//
+/*---------------------------------------------------------------------------------------------
+ This is free software: you can redistribute it and/or modify it under the terms of the GNU
+ Lesser General Public License as published by the Free Software Foundation, version 3 or later.
+ http://www.gnu.org/licenses/
+
+ This is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+---------------------------------------------------------------------------------------------*/
+
+// Same as the LightWave example, but with a pattern that never changes, so that the engine and
+// the plugins it uses can all be in static memory: nothing is allocated from the heap, and only
+// the code for those plugins is included in the application. The pattern isn't parsed either:
+// it's loaded from a preset (in program memory) made with the 'pnpreset' host tool (see
+// 'extras/hosttools'), unless the preset is out of date for this version of the library, and
+// then the pattern is started from its commands instead, as in the LightWave example:
+//
+//    pnpreset myPreset 60 "E10 B50 D60 T E101 T E120 F250 T G" > MyPreset.h
+
+#include <Arduino.h>
+#include <NeoPixelShow.h>
+#include <PixelNutLib.h>
+#include <plugins/PNP_LightWave.h>
+#include <plugins/PNP_HueRotate.h>
+#include <plugins/PNP_CountSet.h>
+#include "MyPreset.h"     // light waves that change color periodically
+
+#define DPIN_PIXELS   17
+#define PIXEL_COUNT   MYPRESET_PIXELS
+
+byte pixelArray[PIXEL_COUNT*3];
+byte *pPixelData = pixelArray;
+NeoPixelShow neoPixels = NeoPixelShow(DPIN_PIXELS);
+
+PixelValOrder pixorder = {1,0,2};
+PixelNutSupport pixelNutSupport = PixelNutSupport(millis, &pixorder);
+PixelNutStatic<PIXEL_COUNT, MYPRESET_LAYERS, MYPRESET_TRACKS> pixelNutEngine(pPixelData);
+
+StaticPluginRegistry< MYPRESET_LAYERS,
+                      PluginEntry<10,  PNP_LightWave>,
+                      PluginEntry<101, PNP_HueRotate>,
+                      PluginEntry<120, PNP_CountSet> > pluginRegistry;
+
+PluginFactory *pPluginFactory = NULL; // not used
+
+void setup()
+{
+  pixelNutEngine.setPluginFactory(&pluginRegistry);
+
+  if (pixelNutEngine.loadPreset(myPreset) != PixelNutEngine::Status_Success)
+  {
+    char pattern[sizeof(MYPRESET_PATTERN)]; // execCmdStr() modifies the string
+    strcpy_P(pattern, PSTR(MYPRESET_PATTERN));
+    pixelNutEngine.execCmdStr(pattern); // the preset must be made again: start the pattern instead
+  }
+}
+
+void loop()
+{
+  if (pixelNutEngine.updateEffects())
+    neoPixels.show(pPixelData, PIXEL_COUNT*3);
+}
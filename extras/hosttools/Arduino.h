@@ -0,0 +1,47 @@
+// PixelNut Host Tools: Arduino Replacement Header
+// Provides just enough of the Arduino environment to compile the PixelNut Library on a host
+// computer (Linux/macOS) for the tools in this directory. Not used by the Arduino build.
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+
+// program memory is just normal memory on a host
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+
+class __FlashStringHelper;
+#define F(x) ((const __FlashStringHelper*)(x))
+
+// random numbers come from a simple generator that is seeded by each tool, so that the
+// same seed always produces exactly the same effects no matter what host is used
+inline uint32_t &hostRandomState(void) { static uint32_t state = 1; return state; }
+
+inline void randomSeed(unsigned long seed) { hostRandomState() = seed; }
+
+inline long random(long howbig)
+{
+  if (howbig <= 0) return 0;
+  uint32_t &state = hostRandomState();
+  state = (state * 1103515245u) + 12345u;
+  return ((state >> 1) % howbig);
+}
+
+inline long random(long howsmall, long howbig)
+{
+  if (howsmall >= howbig) return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
@@ -0,0 +1,64 @@
+// PixelNut Host Tools: Engine Support Definitions
+// Defines the objects the PixelNut Library expects the application to provide, using a virtual
+// clock instead of real time. Must be included by exactly one file of each tool.
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+#include <PixelNutLib.h>
+
+#define HOST_NUM_LAYERS   16      // max effect layers for each pattern
+#define HOST_NUM_TRACKS   16      // max effect tracks for each pattern
+#define HOST_RANDOM_SEED  1       // seed for each pattern, so every run draws the same pixels
+
+static uint32_t hostMsecs = 0;    // virtual clock: only advanced by the tools themselves
+static uint32_t HostGetMsecs(void) { return hostMsecs; }
+
+static PixelValOrder hostPixOrder = {0,1,2}; // RGB as stored by the engine
+PixelNutSupport pixelNutSupport = PixelNutSupport(HostGetMsecs, &hostPixOrder);
+
+PluginFactory hostPluginFactory = PluginFactory();
+PluginFactory *pPluginFactory = &hostPluginFactory;
+
+// frees everything created for a pattern
+static void HostEndPattern(PixelNutEngine *pEngine, byte *pixels)
+{
+  pEngine->clearStack(); // deletes the plugins and their buffers
+  free(pixels);          // (the engine itself has no destructor, and is left behind)
+}
+
+// creates an engine for a pattern, starting the virtual clock and random numbers over again,
+// returns NULL if the engine could not be created or the pattern is invalid
+static PixelNutEngine *HostStartPattern(const char *pattern, uint16_t numpixels, byte **ppixels)
+{
+  hostMsecs = 1; // the engine treats time 0 as not started
+  randomSeed(HOST_RANDOM_SEED);
+
+  byte *pixels = (byte*)calloc(numpixels, 3);
+  if (pixels == NULL) return NULL;
+
+  PixelNutEngine *pEngine = new PixelNutEngine(pixels, numpixels, 0, true, HOST_NUM_LAYERS, HOST_NUM_TRACKS);
+  if (pEngine->pDrawPixels == NULL)
+  {
+    HostEndPattern(pEngine, pixels);
+    return NULL;
+  }
+
+  char *cmdstr = strdup(pattern); // is modified by the parsing
+  PixelNutEngine::Status status = pEngine->execCmdStr(cmdstr);
+  free(cmdstr);
+
+  if (status != PixelNutEngine::Status_Success)
+  {
+    fprintf(stderr, "Pattern failed (status=%d): %s\n", status, pattern);
+    HostEndPattern(pEngine, pixels);
+    return NULL;
+  }
+
+  *ppixels = pixels;
+  return pEngine;
+}
@@ -0,0 +1,447 @@
+// PixelNut Host Tools: Golden Frame Recorder and Comparer
+//
+// Runs each pattern in a corpus on the host with a virtual clock and seeded random numbers,
+// recording every frame the engine shows into a compact binary stream. Two such streams,
+// recorded from different builds of the library, are then compared frame by frame to show
+// the first place each pattern diverges, and how fast each build rendered it.
+//
+// Build from the library directory (the Arduino build ignores the 'extras' directory):
+//
+//    g++ -O2 -std=gnu++11 -I extras/hosttools -I . -o pngolden extras/hosttools/pngolden.cpp *.cpp
+//
+// Usage:
+//
+//    pngolden record <corpus> <outfile> [seconds]   (default is 20 seconds of each pattern)
+//    pngolden compare <file1> <file2>               (exits with 1 if any pattern diverges)
+//
+// The corpus is a text file with a pattern on each line, preceded by the number of pixels
+// to use for it: "60 E10 D20 T G". Blank lines and lines starting with '#' are ignored.
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#include "HostSupport.h"
+#include <time.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Frame stream format (all values are little endian):
+//
+//    header:   "PNGF" version(1)
+//    pattern:  'P' pixels(2) length(2) pattern(length) msecs(4)
+//    frame:    'F' time-since-previous-frame(varint) pixel-changes
+//    end:      'E' frames(4) usecs(4)  (time the engine took to render all the frames)
+//
+// The pixel changes are the pixel bytes XOR'ed with the previous frame, stored as pairs of
+// (number of unchanged bytes, number of changed bytes) as varints, followed by the changed bytes,
+// until all of the bytes in the frame have been accounted for.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define STREAM_VERSION    1
+#define MAX_PATTERN_LEN   1000
+
+static void PutValue(FILE *file, uint32_t value, int bytes)
+{
+  for (int i = 0; i < bytes; ++i, value >>= 8) fputc((value & 0xFF), file);
+}
+
+static bool GetValue(FILE *file, uint32_t *pvalue, int bytes)
+{
+  uint32_t value = 0;
+  for (int i = 0; i < bytes; ++i)
+  {
+    int c = fgetc(file);
+    if (c == EOF) return false;
+    value |= ((uint32_t)c << (i * 8));
+  }
+  *pvalue = value;
+  return true;
+}
+
+static void PutVarint(FILE *file, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    fputc((value & 0x7F) | 0x80, file);
+    value >>= 7;
+  }
+  fputc(value, file);
+}
+
+static bool GetVarint(FILE *file, uint32_t *pvalue)
+{
+  uint32_t value = 0;
+  for (int shift = 0; shift < 35; shift += 7)
+  {
+    int c = fgetc(file);
+    if (c == EOF) return false;
+    value |= ((uint32_t)(c & 0x7F) << shift);
+    if (!(c & 0x80))
+    {
+      *pvalue = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+// writes the changes from the previous frame, then makes this frame the previous one
+static void PutFrame(FILE *file, byte *pixels, byte *prevpixels, uint32_t numbytes)
+{
+  uint32_t i = 0;
+  while (i < numbytes)
+  {
+    uint32_t start = i;
+    while ((i < numbytes) && (pixels[i] == prevpixels[i])) ++i;
+    uint32_t same = i - start;
+
+    start = i;
+    while ((i < numbytes) && (pixels[i] != prevpixels[i])) ++i;
+
+    PutVarint(file, same);
+    PutVarint(file, (i - start));
+    for (uint32_t j = start; j < i; ++j) fputc((pixels[j] ^ prevpixels[j]), file);
+  }
+
+  memcpy(prevpixels, pixels, numbytes);
+}
+
+// applies the changes from the previous frame to the pixels, returns false if the stream is bad
+static bool GetFrame(FILE *file, byte *pixels, uint32_t numbytes)
+{
+  uint32_t i = 0;
+  while (i < numbytes)
+  {
+    uint32_t same, changed;
+    if (!GetVarint(file, &same) || !GetVarint(file, &changed) ||
+        ((i + same + changed) > numbytes))
+      return false;
+
+    for (i += same; changed > 0; --changed, ++i)
+    {
+      int c = fgetc(file);
+      if (c == EOF) return false;
+      pixels[i] ^= c;
+    }
+  }
+  return true;
+}
+
+static uint32_t Microsecs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Recording
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// runs the pattern for 'msecs' of virtual time, advancing the clock by 1 msec each time
+static bool RecordPattern(FILE *file, const char *pattern, uint16_t numpixels, uint32_t msecs)
+{
+  byte *pixels;
+  PixelNutEngine *pEngine = HostStartPattern(pattern, numpixels, &pixels);
+  if (pEngine == NULL) return false;
+
+  uint32_t numbytes = (numpixels * 3);
+  byte *prevpixels = (byte*)calloc(numbytes, 1);
+  if (prevpixels == NULL)
+  {
+    HostEndPattern(pEngine, pixels);
+    return false;
+  }
+
+  fputc('P', file);
+  PutValue(file, numpixels, 2);
+  PutValue(file, strlen(pattern), 2);
+  fwrite(pattern, 1, strlen(pattern), file);
+  PutValue(file, msecs, 4);
+
+  uint32_t frames = 0, usecs = 0, prevtime = hostMsecs;
+  uint32_t endtime = hostMsecs + msecs;
+
+  for (; hostMsecs < endtime; ++hostMsecs)
+  {
+    uint32_t start = Microsecs();
+    bool doshow = pEngine->updateEffects();
+    usecs += (Microsecs() - start);
+
+    if (doshow)
+    {
+      fputc('F', file);
+      PutVarint(file, (hostMsecs - prevtime));
+      PutFrame(file, pixels, prevpixels, numbytes);
+
+      prevtime = hostMsecs;
+      ++frames;
+    }
+  }
+
+  fputc('E', file);
+  PutValue(file, frames, 4);
+  PutValue(file, usecs, 4);
+
+  printf("%-40s %5d px: %6u frames, %8.0f fps\n", pattern, numpixels, frames,
+         (usecs ? ((frames * 1000000.0) / usecs) : 0.0));
+
+  free(prevpixels);
+  HostEndPattern(pEngine, pixels);
+  return true;
+}
+
+static int Record(const char *corpusname, const char *outname, uint32_t msecs)
+{
+  FILE *corpus = fopen(corpusname, "r");
+  if (corpus == NULL)
+  {
+    fprintf(stderr, "Cannot open corpus: %s\n", corpusname);
+    return 2;
+  }
+
+  FILE *file = fopen(outname, "wb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Cannot create file: %s\n", outname);
+    fclose(corpus);
+    return 2;
+  }
+
+  fwrite("PNGF", 1, 4, file);
+  fputc(STREAM_VERSION, file);
+
+  char line[MAX_PATTERN_LEN+10];
+  int failed = 0;
+
+  while (fgets(line, sizeof(line), corpus) != NULL)
+  {
+    char *p = line + strlen(line);
+    while ((p > line) && isspace(p[-1])) *--p = 0; // trim end of line
+
+    p = line;
+    while (isspace(*p)) ++p;
+    if (!*p || (*p == '#')) continue;
+
+    int numpixels = atoi(p);
+    while (isdigit(*p)) ++p;
+    while (isspace(*p)) ++p;
+
+    if ((numpixels <= 0) || (numpixels > MAX_WORD_VALUE) || !*p)
+    {
+      fprintf(stderr, "Invalid corpus line: %s\n", line);
+      ++failed;
+    }
+    else if (!RecordPattern(file, p, numpixels, msecs)) ++failed;
+  }
+
+  fclose(file);
+  fclose(corpus);
+  return (failed ? 2 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Comparing
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+  FILE *file;
+  uint32_t numpixels, msecs;
+  char pattern[MAX_PATTERN_LEN+1];
+  byte *pixels;
+  uint32_t time;                    // time of the current frame
+  uint32_t frames, usecs;           // from the end of the pattern
+}
+StreamInfo;
+
+static bool OpenStream(StreamInfo *pinfo, const char *name)
+{
+  memset(pinfo, 0, sizeof(StreamInfo));
+  pinfo->file = fopen(name, "rb");
+  if (pinfo->file == NULL)
+  {
+    fprintf(stderr, "Cannot open file: %s\n", name);
+    return false;
+  }
+
+  char magic[4];
+  if ((fread(magic, 1, 4, pinfo->file) != 4) || memcmp(magic, "PNGF", 4) ||
+      (fgetc(pinfo->file) != STREAM_VERSION))
+  {
+    fprintf(stderr, "Not a frame stream (or wrong version): %s\n", name);
+    return false;
+  }
+  return true;
+}
+
+// reads the start of the next pattern, returns 0 if at the end of the stream, -1 if invalid
+static int NextPattern(StreamInfo *pinfo)
+{
+  int c = fgetc(pinfo->file);
+  if (c == EOF) return 0;
+
+  uint32_t len;
+  if ((c != 'P') || !GetValue(pinfo->file, &pinfo->numpixels, 2) ||
+      !GetValue(pinfo->file, &len, 2) || (len > MAX_PATTERN_LEN) ||
+      (fread(pinfo->pattern, 1, len, pinfo->file) != len) ||
+      !GetValue(pinfo->file, &pinfo->msecs, 4))
+    return -1;
+
+  pinfo->pattern[len] = 0;
+  pinfo->time = 1;
+
+  free(pinfo->pixels);
+  pinfo->pixels = (byte*)calloc(pinfo->numpixels, 3);
+  return ((pinfo->pixels != NULL) ? 1 : -1);
+}
+
+// reads the next frame of the pattern, returns 0 if at the end of the pattern, -1 if invalid
+static int NextFrame(StreamInfo *pinfo)
+{
+  int c = fgetc(pinfo->file);
+  if (c == 'E')
+    return ((GetValue(pinfo->file, &pinfo->frames, 4) &&
+             GetValue(pinfo->file, &pinfo->usecs, 4)) ? 0 : -1);
+
+  uint32_t delta;
+  if ((c != 'F') || !GetVarint(pinfo->file, &delta) ||
+      !GetFrame(pinfo->file, pinfo->pixels, (pinfo->numpixels * 3)))
+    return -1;
+
+  pinfo->time += delta;
+  return 1;
+}
+
+static double FramesPerSec(StreamInfo *pinfo)
+{
+  return (pinfo->usecs ? ((pinfo->frames * 1000000.0) / pinfo->usecs) : 0.0);
+}
+
+static int Compare(const char *name1, const char *name2)
+{
+  StreamInfo info1, info2;
+  if (!OpenStream(&info1, name1) || !OpenStream(&info2, name2)) return 2;
+
+  int diverged = 0;
+
+  while (true)
+  {
+    int ret1 = NextPattern(&info1);
+    int ret2 = NextPattern(&info2);
+    if ((ret1 < 0) || (ret2 < 0))
+    {
+      fprintf(stderr, "Invalid frame stream\n");
+      return 2;
+    }
+    if (!ret1 || !ret2)
+    {
+      if (ret1 || ret2) printf("Streams have a different number of patterns\n");
+      break;
+    }
+
+    if ((info1.numpixels != info2.numpixels) || (info1.msecs != info2.msecs) ||
+        strcmp(info1.pattern, info2.pattern))
+    {
+      printf("Streams were recorded from different corpuses: \"%s\" and \"%s\"\n",
+             info1.pattern, info2.pattern);
+      return 2;
+    }
+
+    uint32_t frame = 0, badframes = 0, maxdiff = 0;
+    bool first = true;
+    char result[200] = "identical";
+
+    while (true)
+    {
+      ret1 = NextFrame(&info1);
+      ret2 = NextFrame(&info2);
+      if ((ret1 < 0) || (ret2 < 0))
+      {
+        fprintf(stderr, "Invalid frame stream\n");
+        return 2;
+      }
+
+      if (!ret1 || !ret2) // read to the end of the longer one
+      {
+        if (first && (ret1 || ret2))
+        {
+          sprintf(result, "DIVERGES after frame %u: only one build shows more frames", frame);
+          first = false;
+        }
+        while (ret1 > 0) ret1 = NextFrame(&info1);
+        while (ret2 > 0) ret2 = NextFrame(&info2);
+        if ((ret1 < 0) || (ret2 < 0))
+        {
+          fprintf(stderr, "Invalid frame stream\n");
+          return 2;
+        }
+        break;
+      }
+
+      int firstbyte = -1;
+      for (uint32_t i = 0; i < (info1.numpixels * 3); ++i)
+      {
+        int diff = abs(info1.pixels[i] - info2.pixels[i]);
+        if (diff)
+        {
+          if (firstbyte < 0) firstbyte = i;
+          if (maxdiff < (uint32_t)diff) maxdiff = diff;
+        }
+      }
+
+      if ((firstbyte >= 0) || (info1.time != info2.time))
+      {
+        if (first)
+        {
+          if (info1.time != info2.time)
+               sprintf(result, "DIVERGES at frame %u: shown at %u and %u msecs",
+                       frame, info1.time, info2.time);
+          else
+          {
+            byte *p1 = &info1.pixels[(firstbyte / 3) * 3];
+            byte *p2 = &info2.pixels[(firstbyte / 3) * 3];
+            sprintf(result, "DIVERGES at frame %u (%u msecs) pixel %d: %d.%d.%d vs %d.%d.%d",
+                    frame, info1.time, (firstbyte / 3), p1[0], p1[1], p1[2], p2[0], p2[1], p2[2]);
+          }
+          first = false;
+        }
+        ++badframes;
+      }
+      ++frame;
+    }
+
+    double fps1 = FramesPerSec(&info1);
+    double fps2 = FramesPerSec(&info2);
+
+    printf("%-40s %5u px: %s\n", info1.pattern, info1.numpixels, result);
+    if (!first)
+    {
+      printf("%47s %u of %u frames differ, max difference %u\n", "", badframes, frame, maxdiff);
+      ++diverged;
+    }
+    printf("%47s %.0f vs %.0f fps (%.2fx)\n", "", fps1, fps2, (fps1 ? (fps2 / fps1) : 0.0));
+  }
+
+  printf("%d pattern(s) diverged\n", diverged);
+  return (diverged ? 1 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+  if ((argc >= 4) && !strcmp(argv[1], "record"))
+  {
+    uint32_t seconds = ((argc > 4) ? atoi(argv[4]) : 20);
+    return Record(argv[2], argv[3], (seconds * 1000));
+  }
+
+  if ((argc == 4) && !strcmp(argv[1], "compare"))
+    return Compare(argv[2], argv[3]);
+
+  fprintf(stderr, "Usage: %s record <corpus> <outfile> [seconds]\n", argv[0]);
+  fprintf(stderr, "       %s compare <file1> <file2>\n", argv[0]);
+  return 2;
+}
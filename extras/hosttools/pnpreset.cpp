@@ -0,0 +1,81 @@
+// PixelNut Host Tools: Pattern Preset Maker
+//
+// Starts a pattern on the host, exactly as 'execCmdStr()' would on the device, then writes the
+// state of the engine at that moment (without the pixels, which are all still dark) as a C header
+// with a byte array, which an application built for a fixed pattern loads at power-on with
+// 'loadPreset()' (see 'PixelNutStatic.h'), instead of parsing the pattern and starting its effects.
+//
+// Build from the library directory (the Arduino build ignores the 'extras' directory):
+//
+//    g++ -O2 -std=gnu++11 -I extras/hosttools -I . -o pnpreset extras/hosttools/pnpreset.cpp *.cpp
+//
+// Usage:
+//
+//    pnpreset <name> <pixels> <pattern> > <name>.h
+//
+// The header defines the array 'name' (in program memory), and NAME_PIXELS, NAME_LAYERS, NAME_TRACKS
+// for the engine, along with NAME_PATTERN for starting the pattern itself if the preset is rejected.
+// The saved state is the same on any little endian processor, but it must be made again whenever
+// the library changes the format of the saved state, or the state saved by any of the plugins used.
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#include "HostSupport.h"
+#include <ctype.h>
+
+#define BYTES_PER_LINE 16
+
+int main(int argc, char **argv)
+{
+  if (argc != 4)
+  {
+    fprintf(stderr, "Usage: %s <name> <pixels> <pattern>\n", argv[0]);
+    return 1;
+  }
+
+  const char *name = argv[1];
+  int numpixels = atoi(argv[2]);
+  const char *pattern = argv[3];
+
+  if ((numpixels <= 0) || (numpixels > MAX_WORD_VALUE))
+  {
+    fprintf(stderr, "Invalid number of pixels: %s\n", argv[2]);
+    return 1;
+  }
+
+  byte *pixels;
+  PixelNutEngine *pEngine = HostStartPattern(pattern, numpixels, &pixels);
+  if (pEngine == NULL) return 1;
+
+  uint32_t len = pEngine->saveState(NULL, 0, false);
+  byte *pstate = (byte*)malloc(len);
+  if ((pstate == NULL) || (pEngine->saveState(pstate, len, false) != len))
+  {
+    fprintf(stderr, "Cannot save the state: %lu bytes\n", (unsigned long)len);
+    return 1;
+  }
+
+  char upname[100];
+  int i;
+  for (i = 0; name[i] && (i < (int)sizeof(upname)-1); ++i) upname[i] = toupper(name[i]);
+  upname[i] = 0;
+
+  printf("// Preset made by 'pnpreset' (extras/hosttools): do not edit, make it again instead.\n");
+  printf("// Pattern on %d pixels: %s\n\n", numpixels, pattern);
+  printf("#define %s_PIXELS %d\n", upname, numpixels);
+  printf("#define %s_LAYERS %d\n", upname, PatternLayers(pattern));
+  printf("#define %s_TRACKS %d\n\n", upname, PatternTracks(pattern));
+  printf("#define %s_PATTERN \"%s\"\n\n", upname, pattern);
+  printf("PROGMEM const byte %s[%lu] = {", name, (unsigned long)len);
+
+  for (uint32_t j = 0; j < len; ++j)
+    printf("%s0x%02X", ((j % BYTES_PER_LINE) ? ", " : (j ? ",\n  " : "\n  ")), pstate[j]);
+  printf("\n};\n");
+
+  free(pstate);
+  HostEndPattern(pEngine, pixels);
+  return 0;
+}
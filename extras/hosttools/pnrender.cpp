@@ -0,0 +1,191 @@
+// PixelNut Host Tools: Offline Pattern Renderer
+//
+// Renders each pattern in a corpus for a number of seconds of simulated time, writing every
+// frame the engine shows into a file, as fast as the host can: instead of waiting, the virtual
+// clock is advanced directly to the time the engine next needs to update ('nextUpdateTime()').
+// Patterns are rendered in parallel, by a separate process for each, up to the number of cores.
+//
+// Build from the library directory (the Arduino build ignores the 'extras' directory):
+//
+//    g++ -O2 -std=gnu++11 -I extras/hosttools -I . -o pnrender extras/hosttools/pnrender.cpp *.cpp
+//
+// Usage:
+//
+//    pnrender <corpus> <outdir> <seconds> [jobs]
+//
+// The corpus is the same as for 'pngolden': a pattern on each line, preceded by the number of
+// pixels to use for it. The frames for the Nth pattern (from 1) are written to "<outdir>/patternN.pnr".
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#include "HostSupport.h"
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Frame file format (all values are little endian):
+//
+//    header:   "PNRF" version(1) 0(1) pixels(2)
+//    frame:    msecs(4) pixel-bytes(pixels*3)
+//
+// Every frame is the same size, so a file can be mapped into memory and any frame found directly.
+// The time of each frame is from the start of the pattern.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define FILE_VERSION      1
+#define MAX_PATTERN_LEN   1000
+
+static void PutValue(FILE *file, uint32_t value, int bytes)
+{
+  for (int i = 0; i < bytes; ++i, value >>= 8) fputc((value & 0xFF), file);
+}
+
+static double Seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+// renders one pattern into a file, returns false if failed
+static bool RenderPattern(const char *pattern, uint16_t numpixels, const char *outname, uint32_t msecs)
+{
+  byte *pixels;
+  PixelNutEngine *pEngine = HostStartPattern(pattern, numpixels, &pixels);
+  if (pEngine == NULL) return false;
+
+  FILE *file = fopen(outname, "wb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Cannot create file: %s\n", outname);
+    HostEndPattern(pEngine, pixels);
+    return false;
+  }
+
+  fwrite("PNRF", 1, 4, file);
+  fputc(FILE_VERSION, file);
+  fputc(0, file);
+  PutValue(file, numpixels, 2);
+
+  double start = Seconds();
+  uint32_t starttime = hostMsecs;
+  uint32_t endtime = hostMsecs + msecs;
+  uint32_t frames = 0;
+
+  while (true)
+  {
+    uint32_t next = pEngine->nextUpdateTime();
+    if ((next == 0) || (next >= endtime)) break; // nothing more will change within the time
+
+    hostMsecs = next;
+    if (pEngine->updateEffects())
+    {
+      PutValue(file, (hostMsecs - starttime), 4);
+      fwrite(pixels, 3, numpixels, file);
+      ++frames;
+    }
+
+    if (next == pEngine->nextUpdateTime()) ++hostMsecs; // didn't move on: must advance time
+  }
+
+  bool success = !ferror(file);
+  if (fclose(file) != 0) success = false;
+
+  double secs = Seconds() - start;
+  printf("%-40s %5d px: %7u frames in %6.2f secs (%.0fx real time)%s\n", pattern, numpixels,
+         frames, secs, ((secs > 0) ? ((msecs / 1000.0) / secs) : 0.0), (success ? "" : " WRITE FAILED"));
+
+  HostEndPattern(pEngine, pixels);
+  return success;
+}
+
+static int Render(const char *corpusname, const char *outdir, uint32_t msecs, int jobs)
+{
+  FILE *corpus = fopen(corpusname, "r");
+  if (corpus == NULL)
+  {
+    fprintf(stderr, "Cannot open corpus: %s\n", corpusname);
+    return 2;
+  }
+
+  char line[MAX_PATTERN_LEN+10];
+  char outname[FILENAME_MAX];
+  int patnum = 0, running = 0, failed = 0;
+  int status;
+
+  fflush(stdout); // don't duplicate buffered output in each process
+
+  while (fgets(line, sizeof(line), corpus) != NULL)
+  {
+    char *p = line + strlen(line);
+    while ((p > line) && isspace(p[-1])) *--p = 0; // trim end of line
+
+    p = line;
+    while (isspace(*p)) ++p;
+    if (!*p || (*p == '#')) continue;
+
+    int numpixels = atoi(p);
+    while (isdigit(*p)) ++p;
+    while (isspace(*p)) ++p;
+
+    if ((numpixels <= 0) || (numpixels > MAX_WORD_VALUE) || !*p)
+    {
+      fprintf(stderr, "Invalid corpus line: %s\n", line);
+      ++failed;
+      continue;
+    }
+
+    snprintf(outname, sizeof(outname), "%s/pattern%d.pnr", outdir, ++patnum);
+
+    if (running >= jobs) // wait for one to finish first
+    {
+      wait(&status);
+      if (!WIFEXITED(status) || WEXITSTATUS(status)) ++failed;
+      --running;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      bool success = RenderPattern(p, numpixels, outname, msecs);
+      fflush(stdout);
+      _exit(success ? 0 : 1);
+    }
+    else if (pid < 0) // cannot create process: render it here instead
+    {
+      if (!RenderPattern(p, numpixels, outname, msecs)) ++failed;
+      fflush(stdout);
+    }
+    else ++running;
+  }
+
+  while (running-- > 0)
+  {
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) ++failed;
+  }
+
+  fclose(corpus);
+  return (failed ? 2 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+  if ((argc == 4) || (argc == 5))
+  {
+    int seconds = atoi(argv[3]);
+    int jobs = ((argc > 4) ? atoi(argv[4]) : (int)sysconf(_SC_NPROCESSORS_ONLN));
+    if (jobs <= 0) jobs = 1;
+
+    if (seconds > 0) return Render(argv[1], argv[2], (seconds * 1000), jobs);
+  }
+
+  fprintf(stderr, "Usage: %s <corpus> <outdir> <seconds> [jobs]\n", argv[0]);
+  return 2;
+}
@@ -0,0 +1,162 @@
+// PixelNut Host Tools: Network Packet Loopback Test
+//
+// Runs a pattern with a virtual clock, sending each frame shown as E1.31 or DDP packets
+// (made by the PixelNutPackets class) over UDP to a receiver on the local loopback interface,
+// which rebuilds the pixels from the packets it receives. Checks that the receiver always has
+// exactly the pixels that were shown, and how many packets/bytes were needed to do that.
+//
+// Build from the library directory (the Arduino build ignores the 'extras' directory):
+//
+//    g++ -O2 -std=gnu++11 -I extras/hosttools -I . -o pnudp extras/hosttools/pnudp.cpp *.cpp
+//
+// Usage:
+//
+//    pnudp <e131|ddp> <pixels> <pattern> [seconds]   (default is 20 seconds)
+//
+// Exits with 1 if the receiver's pixels were ever different from those shown.
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#include "HostSupport.h"
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_PACKET_BYTES 1500
+
+static uint16_t GetWord(byte *p) { return ((p[0] << 8) | p[1]); }
+static uint32_t GetLong(byte *p) { return (((uint32_t)GetWord(p) << 16) | GetWord(p+2)); }
+
+// applies a received packet to the pixels, returns false if it isn't valid
+static bool ReceivePacket(PixelNutPackets::Protocol protocol, byte *packet, int len,
+                          byte *pixels, uint16_t numpixels)
+{
+  uint32_t offset, count;
+  byte *pvals;
+
+  if (protocol == PixelNutPackets::Protocol_E131)
+  {
+    if ((len < E131_HEADER_BYTES) || memcmp((packet+4), "ASC-E1.17", 9) ||
+        (GetLong(packet+18) != 4) || (GetLong(packet+40) != 2) || (packet[118] != 0xA1) ||
+        ((GetWord(packet+16) & 0xFFF) != (len - 16)) || packet[125]) // start code
+      return false;
+
+    offset = (uint32_t)(GetWord(packet+113) - 1) * E131_UNIVERSE_PIXELS * 3;
+    count = GetWord(packet+123) - 1;
+    pvals = packet + E131_HEADER_BYTES;
+  }
+  else
+  {
+    if ((len < DDP_HEADER_BYTES) || ((packet[0] & 0xC0) != 0x40)) return false;
+
+    offset = GetLong(packet+4);
+    count = GetWord(packet+8);
+    pvals = packet + DDP_HEADER_BYTES;
+  }
+
+  if (((pvals + count) != (packet + len)) || ((offset + count) > (numpixels * 3u))) return false;
+
+  memcpy((pixels + offset), pvals, count);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  if ((argc < 4) || (strcmp(argv[1], "e131") && strcmp(argv[1], "ddp")))
+  {
+    fprintf(stderr, "Usage: %s <e131|ddp> <pixels> <pattern> [seconds]\n", argv[0]);
+    return 2;
+  }
+
+  PixelNutPackets::Protocol protocol = (strcmp(argv[1], "ddp") ? PixelNutPackets::Protocol_E131 :
+                                                                 PixelNutPackets::Protocol_DDP);
+  int numpixels = atoi(argv[2]);
+  uint32_t msecs = ((argc > 4) ? atoi(argv[4]) : 20) * 1000;
+
+  if ((numpixels <= 0) || (numpixels > MAX_WORD_VALUE))
+  {
+    fprintf(stderr, "Invalid number of pixels: %s\n", argv[2]);
+    return 2;
+  }
+
+  byte *pixels;
+  PixelNutEngine *pEngine = HostStartPattern(argv[3], numpixels, &pixels);
+  if (pEngine == NULL) return 2;
+
+  PixelNutPackets packets(protocol, numpixels);
+  byte *received = (byte*)calloc(numpixels, 3);
+  if ((packets.pPackets == NULL) || (received == NULL))
+  {
+    fprintf(stderr, "Not enough memory\n");
+    return 2;
+  }
+
+  // receiver is bound to any free port on the loopback interface, which the sender sends to
+  int rxsock = socket(AF_INET, SOCK_DGRAM, 0);
+  int txsock = socket(AF_INET, SOCK_DGRAM, 0);
+
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int bufsize = 4 * 1024 * 1024; // room for all packets of a frame
+  setsockopt(rxsock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+
+  if ((rxsock < 0) || (txsock < 0) || bind(rxsock, (struct sockaddr*)&addr, sizeof(addr)) ||
+      getsockname(rxsock, (struct sockaddr*)&addr, &addrlen))
+  {
+    fprintf(stderr, "Cannot create loopback sockets: %s\n", strerror(errno));
+    return 2;
+  }
+
+  uint32_t frames = 0, sent = 0, bytes = 0, badframes = 0, badpackets = 0;
+  byte rxpacket[MAX_PACKET_BYTES];
+
+  for (; hostMsecs < msecs; ++hostMsecs)
+  {
+    if (!pEngine->updateEffects()) continue;
+
+    uint16_t count = packets.makePackets(pixels);
+    for (uint16_t i = 0; i < count; ++i)
+    {
+      uint16_t len;
+      byte *packet = packets.getPacket(i, &len);
+      if (sendto(txsock, packet, len, 0, (struct sockaddr*)&addr, sizeof(addr)) != len)
+      {
+        fprintf(stderr, "Cannot send packet: %s\n", strerror(errno));
+        return 2;
+      }
+      bytes += len;
+    }
+    sent += count;
+
+    for (uint16_t i = 0; i < count; ++i) // loopback delivers them in order
+    {
+      int len = recv(rxsock, rxpacket, sizeof(rxpacket), 0);
+      if ((len < 0) || !ReceivePacket(protocol, rxpacket, len, received, numpixels)) ++badpackets;
+    }
+
+    if (memcmp(received, pixels, (numpixels * 3))) ++badframes;
+    ++frames;
+  }
+
+  uint32_t headerbytes = ((protocol == PixelNutPackets::Protocol_E131) ? E131_HEADER_BYTES : DDP_HEADER_BYTES);
+  uint32_t fullbytes = frames * ((numpixels * 3) + (packets.getNumPackets() * headerbytes));
+
+  printf("%s: %u frames, %u of %u packets sent, %u bytes (%.1f%% of sending all), %u bad packets, %u bad frames\n",
+         argv[1], frames, sent, (frames * packets.getNumPackets()), bytes,
+         (fullbytes ? ((bytes * 100.0) / fullbytes) : 0.0), badpackets, badframes);
+
+  close(rxsock);
+  close(txsock);
+  free(received);
+  HostEndPattern(pEngine, pixels);
+  return ((badframes || badpackets) ? 1 : 0);
+}
@@ -9,6 +9,15 @@
 
 #pragma once
 
+#define TRIGGER_QUEUE_SIZE 8 // max number of layers that can have triggers waiting to be sent
+#ifndef COMMAND_QUEUE_SIZE // can be set here, or with a compiler flag, to use the queue calls below
+#define COMMAND_QUEUE_SIZE 0 // bytes for commands queued by other tasks/interrupts (power of 2 up to 256, or 0)
+#endif
+
+#if (COMMAND_QUEUE_SIZE > 256) || (COMMAND_QUEUE_SIZE & (COMMAND_QUEUE_SIZE-1))
+#error "COMMAND_QUEUE_SIZE must be a power of 2 up to 256"
+#endif
+
 class PixelNutEngine
 {
 public:
@@ -39,6 +48,15 @@ public:
     ExtControlBit_All        = 7    // all bits ORed together
   };
 
+  // Determines what happens when frame pacing is enabled with 'setFrameRate()', and the
+  // drawing effect for a track has fallen behind its delay time by more than a frame.
+  enum FramePolicy
+  {
+    FramePolicy_DropSteps=0,        // skip missed steps: continue from the current time
+    FramePolicy_CatchUp,            // call nextstep() multiple times (up to a limit) to catch up,
+                                    // or timedstep() just once if all its plugins support that
+  };
+
   // Constructor: init location/length of the pixels to be drawn, 
   // the first pixel to start drawing and the direction of drawing,
   // and the maximum effect layers and tracks that can be supported.
@@ -47,23 +65,37 @@ public:
                  uint16_t first_pixel=0, bool goupwards=true,
                  short num_layers=4, short num_tracks=3);
 
-  void setMaxBrightness(byte percent) { pcentBright = percent; }
+  // Sets the factory that creates the plugins for this engine, instead of using the one that
+  // the application's 'pPluginFactory' points to: such as a 'PluginRegistry' of only the plugins
+  // it uses. Must be set before any patterns are created.
+  void setPluginFactory(PixelNutFactory *pfactory) { pFactory = pfactory; }
+
+  void setMaxBrightness(byte percent) { if (percent != pcentBright) StopLoop(); pcentBright = percent; }
   byte getMaxBrightness() { return pcentBright; }
 
-  void setDelayOffset(int8_t msecs) { delayOffset = msecs; }
+  void setDelayOffset(int8_t msecs) { if (msecs != delayOffset) StopLoop(); delayOffset = msecs; }
   int8_t getDelayOffset() { return delayOffset; }
 
   void setFirstPosition(int16_t pixpos)
   {
     if (pixpos < 0) pixpos = 0;
     if (numPixels <= pixpos) pixpos = numPixels-1;
+    if (pixpos != firstPixel) StopLoop();
     firstPixel = pixpos;
   }
   int16_t getFirstPosition() { return firstPixel; }
 
-  void setDirection(bool goup) { goUpwards = goup; }
+  void setDirection(bool goup) { if (goup != goUpwards) StopLoop(); goUpwards = goup; }
   bool getDirection() { return goUpwards; }
 
+  // Sets the target number of frames per second to be produced by 'updateEffects()'. When set,
+  // the effect tracks are only redrawn on frame boundaries, so that the output is refreshed at
+  // a steady rate no matter how often it's called, and 'policy' determines how tracks that have
+  // fallen behind are handled. A value of 0 (the default) disables frame pacing.
+  void setFrameRate(byte fps, FramePolicy policy=FramePolicy_DropSteps);
+  byte getFrameRate() { return framesPerSec; }
+  FramePolicy getFramePolicy() { return framePolicy; }
+
   // Sets the color properties for tracks that have set either the ExtControlBit_DegreeHue
   // or ExtControlBit_PcentWhite bits. These values can be individually controlled. The
   // 'hue_degree' is a value from 0...MAX_DEGREES_CIRCLE, and the 'white_percent' value
@@ -74,6 +106,13 @@ public:
   // The 'pixcount_percent' value is a percentage from 0...MAX_PERCENTAGE.
   void setCountProperty(byte pixcount_percent);
 
+  // The above only record the new values: they're applied to the tracks once, at the start of
+  // the next frame (or before a trigger or saving the state), so that setting them many times
+  // between frames (such as from a slider) doesn't redo the work each time ('nextUpdateTime()'
+  // returns the time of that frame until then). Returns the number of values that were replaced
+  // before they were ever applied.
+  uint32_t getPropertiesCoalesced(void) { return propsCoalesced; }
+
   // When enabled, predraw effects are prevented from modifying the color/count properties
   // of a track with the corresponding ExtControlBit bit set, allowing only the external
   // control of that property with calls to set..Property().
@@ -91,8 +130,13 @@ public:
   void triggerForce(short force);
 
   // Used by plugins to trigger based on the effect layer, enabled by the "A" command.
+  // The trigger is queued, and sent to the assigned layers on the next call to 'updateEffects()',
+  // with only the latest force kept if the layer triggers again before then.
   void triggerForce(byte layer, short force, PixelNutSupport::DrawProps *pdraw);
 
+  // Returns the number of triggers from plugins that have been dropped because the queue was full.
+  uint16_t getTriggersDropped() { return trigDropped; }
+
   // Called by the above and DoTrigger(), CheckAutoTrigger(), allows override
   virtual void triggerLayer(byte layer, short force);
 
@@ -106,19 +150,172 @@ public:
   // Pops off all layers from the stack
   virtual void clearStack(void);
 
+  #if (COMMAND_QUEUE_SIZE > 0) // left out unless the queue size is set above
+  // These queue calls to the methods above, to be made at the start of the next 'updateEffects()',
+  // for use by a task or an interrupt handler that isn't the one updating the effects, which would
+  // otherwise change the effects while they're being drawn. The queue is lock-free for a single
+  // producer and a single consumer: all of these must be called from the same task or interrupt
+  // (or another producer must disable interrupts just while it queues something). Returns false
+  // if there isn't room in the queue (of COMMAND_QUEUE_SIZE bytes, including 2 for each call).
+  // The command string is copied with its terminator, and is parsed where it is in the queue, so
+  // it can't wrap around the end of it and may need more room. The status of executing it is
+  // given by 'getQueueStatus()'. A trigger can be given the time (from 'getMsecs()') that it
+  // should happen: it's sent on the first update at or after that time, or 0 for the next.
+  // Calls are always made in order, so every call queued after a trigger for a later time is
+  // also held back until then, however long that is.
+  bool queueCmdStr(const char *cmdstr);
+  bool queueColorProperty(short hue_degree, byte white_percent);
+  bool queueCountProperty(byte pixcount_percent);
+  bool queueTriggerForce(short force, uint32_t msecs=0);
+
+  // Returns the status of the last queued command string that failed (then resets it to success),
+  // and the number of calls that have been dropped because the queue was full.
+  Status getQueueStatus(void) { Status status = queueStatus; queueStatus = Status_Success; return status; }
+  uint16_t getQueueDropped(void) { return queueDropped; }
+  #endif
+
   // Updates current effect: returns true if the pixels have changed and should be redisplayed.
   virtual bool updateEffects(void);
 
+  // Returns the time (in msecs, as returned by 'getMsecs()') of the next call to 'updateEffects()'
+  // that can change the pixels: when the next effect is due to be redrawn or auto-triggered, or
+  // the current time if something is already waiting. Returns 0 if nothing will change until
+  // the effects are triggered or another command is executed. Allows the application to sleep
+  // until then, or to advance a virtual clock directly to that time to render faster than real time.
+  uint32_t nextUpdateTime(void);
+
+  // Saves the entire state of the engine: all effect layers and tracks, their pixel buffers, and
+  // the internal state of each plugin, into 'pbuff', returning the number of bytes used, or 0 if
+  // 'maxlen' is too small. If 'pbuff' is NULL, just returns the number of bytes needed. If 'pixels'
+  // is false the pixel buffers are left out, and are cleared when the state is loaded instead.
+  // The saved state is the same on any (little endian) processor, so it can be made on a host
+  // computer and loaded by an application (see 'PixelNutStatic.h').
+  virtual uint32_t saveState(byte *pbuff, uint32_t maxlen, bool pixels=true);
+
+  // Replaces all effects with the state previously saved with 'saveState()', continuing where
+  // they left off, without any commands being executed or plugins being restarted (unless a
+  // plugin cannot save its state). Must have the same number of pixels, and enough layers/tracks.
+  virtual Status loadState(const byte *pbuff, uint32_t len);
+
+  // Keeps up to 'count' patterns resident once built, so that switching between them with
+  // 'switchPattern()' just changes which one is displayed, without freeing/reallocating anything.
+  // If 'maxbytes' is set, the least recently used patterns are evicted to keep the memory used
+  // by the cached patterns (plugins and pixel buffers) within that. The current effects become
+  // the first cached pattern. A 'count' of 0 or 1 disables the cache, keeping only the current
+  // pattern. Returns false if there isn't enough memory for the cache.
+  bool setPatternCache(byte count, uint32_t maxbytes=0);
+
+  // Switches to the pattern identified by 'id' (0...MAX_WORD_VALUE-1) if it's in the cache,
+  // otherwise it replaces the least recently used one, built by executing 'cmdstr' (which is
+  // modified by the parsing). Without a cache, this simply replaces the current pattern.
+  virtual Status switchPattern(uint16_t id, char *cmdstr);
+
+  // Enables playing back effects that have started repeating exactly (such as a scanner moving
+  // back and forth) from a recording of a single loop of them, without calling any plugins.
+  // While searching for a loop, the engine state after each frame is compared with an earlier
+  // one (as saved by 'saveState()'), and once they're the same, the frames in between are played
+  // back over and over, until a command is executed, a setting changed, or a trigger received,
+  // at which point the effects continue on from where the playback left off. Only used when all
+  // plugins are 'repeatable()', and none of the layers are being triggered automatically.
+  // The pixels are only saved and compared when the rest of the state is the same, and searching
+  // stops once loops of up to 'maxframes' frames have been looked for (0 to keep searching until
+  // the recording is full): effects that each repeat quickly can take much longer to repeat
+  // together (a scanner and a hue rotation with different periods only after the least common
+  // multiple of those).
+  // The recording is limited to 'maxbytes' (0 disables this, the default), and searching also
+  // needs twice the size of the saved state, plus a copy of the pixels. Returns false if there
+  // isn't enough memory.
+  bool setLoopPlayback(uint32_t maxbytes, uint16_t maxframes=1024);
+
+  // Returns true if the effects are currently being played back from a recorded loop.
+  bool isLoopPlaying() { return (loopState == LoopState_Playing); }
+
+  // Returns the number of bytes currently used by the effects: the plugin objects, the memory
+  // they allocate themselves, and the pixel buffers of the tracks, for all cached patterns.
+  // Doesn't include the layer/track stacks, the engine's own buffers, or any heap overhead.
+  uint32_t getMemoryUsed(void) { return memUsed; }
+
+  // Returns the largest value that 'getMemoryUsed()' has had, which is then reset to the current
+  // value if 'reset' is set, such as to find the memory needed by each of a set of patterns.
+  uint32_t getMemoryPeak(bool reset=false);
+
+  // Finds the memory that executing 'cmdstr' would need (as counted by 'getMemoryUsed()') without
+  // changing any effects or modifying 'cmdstr', by creating each plugin in turn just to get its
+  // size, returning it in 'pbytes'. Assumes the effects are cleared first (the 'P' command), and
+  // returns the same errors 'execCmdStr()' would for too many layers/tracks or an unknown plugin.
+  // This is an upper bound, as plugins can allocate less once started if memory is short.
+  // With a 'StaticPluginRegistry' there must be a free slot to create the plugins in.
+  Status estimatePatternMemory(const char *cmdstr, uint32_t *pbytes);
+
+  typedef struct // 4 bytes
+  {
+    uint16_t start;                             // first pixel that changed
+    uint16_t count;                             // number of pixels in this range
+  }
+  PixelRange; // defines a range of pixels that changed
+
+  // Enables finding which pixels have changed, so that a display connected over a slow link
+  // only needs to be sent those: each time 'updateEffects()' returns true, the pixels are
+  // compared with the previous frame shown (all are changed the first time), as they are copied
+  // for the next frame. Ranges separated by a single unchanged pixel are combined, and if there
+  // are more than 'maxranges', the last one is extended to include the rest of the changes.
+  // Needs a copy of the pixels. 0 disables this (the default). Returns false if not enough memory.
+  bool setChangedRanges(byte maxranges);
+
+  // Sets 'pranges' to the ranges of pixels that changed in the latest frame (in order), and
+  // returns how many there are (0 if nothing changed, or this hasn't been enabled).
+  byte getChangedRanges(PixelRange **pranges) { *pranges = pChangeRanges; return numChangeRanges; }
+
+  // Encodes the pixels that changed in the latest frame into 'pbuff' as a packet: the number of
+  // ranges, then for each range its first pixel and the number of pixels, followed by the values
+  // for those pixels (3 bytes each, in the same order as in the display). All numbers are 2 bytes,
+  // least significant first. Returns the length of the packet, or 0 if 'maxlen' is too small.
+  // If 'pbuff' is NULL, just returns the number of bytes needed.
+  uint32_t encodeChanges(byte *pbuff, uint32_t maxlen);
+
+  // Adds another output that the pixels are copied into each time 'updateEffects()' returns true,
+  // such as for a second strip of LEDs that needs its values in a different order, so that the
+  // effects don't have to be drawn twice. 'ptr_pixels' (3 bytes per pixel) is set from 'num_pixels'
+  // of the display pixels starting at 'first_pixel' (all of them to the end if 0), in reverse if
+  // 'goupwards' is false, with the values in 'pix_order', and scaled by 'pcent_bright'. All of the
+  // outputs are set in a single pass through the display pixels. Returns false if the pixels are
+  // out of range or there isn't enough memory.
+  bool addOutput(byte *ptr_pixels, PixelValOrder *pix_order, byte pcent_bright=MAX_PERCENTAGE,
+                 uint16_t first_pixel=0, uint16_t num_pixels=0, bool goupwards=true);
+
+  // Changes the brightness of the output at 'index' (in the order they were added).
+  void setOutputBrightness(byte index, byte percent);
+
+  // Removes all of the outputs added with 'addOutput()'.
+  void clearOutputs(void);
+
+  // Returns the number of outputs added with 'addOutput()'.
+  byte getNumOutputs(void) { return numOutputs; }
+
   // Private to the PixelNutSupport class and main application.
   byte *pDrawPixels; // current pixel buffer to draw into or display
+  uint16_t drawOffset; // buffer position of the first pixel, if it has been scrolled
+  uint16_t drawLength; // number of pixels in that buffer (0 if it cannot be scrolled)
+  byte drawPixBytes; // bytes for each pixel in that buffer: 3, or 1 if only intensities
   // Note: test this for NULL after constructor to check if successful!
 
 protected:
 
+  // Used by 'PixelNutStatic' to take all of the stacks, tables, and track buffers from 'pmemory'
+  // (of 'StaticBytes()' bytes) instead of allocating them, so that the engine doesn't use the heap.
+  PixelNutEngine(byte *ptr_pixels, uint16_t num_pixels, uint16_t first_pixel, bool goupwards,
+                 short num_layers, short num_tracks, byte *pmemory);
+
+  static constexpr uint32_t StaticBytes(uint16_t num_pixels, short num_layers, short num_tracks)
+  {
+    return ((num_layers * sizeof(PluginLayer)) + (num_tracks * sizeof(PluginTrack)) +
+            (num_layers + 1) + num_layers + ((uint32_t)num_tracks * num_pixels * 3));
+  }
+
   byte pcentBright = MAX_PERCENTAGE;            // max percent brightness to apply to each effect
   int8_t delayOffset = 0;                       // additional delay to add to each effect (msecs)
 
-  typedef struct ATTR_PACKED // 18-20 bytes
+  typedef struct ATTR_PACKED // 20-22 bytes
   {
                                                 // random auto triggering information:
     uint32_t trigTimeMsecs;                     // time of next trigger in msecs (0 if not set yet)
@@ -133,11 +330,12 @@ protected:
     byte trigSource;                            // what other layer can trigger this layer (255 for none)
 
     byte track;                                 // index into properties stack for plugin
+    uint16_t plugin;                            // plugin number used to create the plugin
     PixelNutPlugin *pPlugin;                    // pointer to the created plugin object
   }
   PluginLayer; // defines each layer of effect plugin
 
-  typedef struct ATTR_PACKED // 28-30 bytes
+  typedef struct ATTR_PACKED // 31-33 bytes
   {
     uint32_t msTimeRedraw;                      // time of next redraw of plugin in msecs
     byte *pRedrawBuff;                          // allocated buffer or NULL for postdraw effects
@@ -148,9 +346,11 @@ protected:
     byte ctrlBits;                              // bits to control setting property values
     byte segIndex;                              // assigned to this segment (from 0)
     byte disable;                               // non-zero to disable controls
+    byte pixBytes;                              // bytes for each pixel in buffer (3, or 1 if intensity only)
 
     uint16_t dspCount;                          // number of pixels to display
     uint16_t dspOffset;                         // offset into output display buffer
+    uint16_t pixOffset;                         // buffer position of first pixel (see scrollPixels())
   }
   PluginTrack; // defines properties for each drawing plugin
 
@@ -163,8 +363,115 @@ protected:
   short maxPluginTracks;                        // max number of tracks possible
   short indexTrackStack = -1;                   // index into the plugin properties stack
 
+  PixelNutFactory *pFactory = NULL;             // creates plugins (NULL to use 'pPluginFactory')
+  byte *pStaticBuffs = NULL;                    // track buffers in static memory (NULL if allocated)
+
+  byte *routeIndex;                             // for each layer: start of the layers it triggers
+  byte *routeLayers;                            // layers triggered by each layer (in layer order)
+
+  typedef struct ATTR_PACKED // 3 bytes
+  {
+    byte layer;                                 // layer that sent the trigger
+    short force;                                // force to trigger assigned layers with
+  }
+  TriggerEvent; // defines triggers waiting to be sent
+
+  TriggerEvent trigQueue[TRIGGER_QUEUE_SIZE];   // ring of triggers waiting to be sent
+  byte trigQueueHead = 0;                       // index of the oldest trigger in the ring
+  byte trigQueueCount = 0;                      // number of triggers in the ring
+  uint16_t trigDropped = 0;                     // number of triggers dropped when it was full
+
   uint32_t timePrevUpdate = 0;                  // time of previous call to update
 
+  #if (COMMAND_QUEUE_SIZE > 0)
+  enum QueueType                                // types of calls in the command queue
+  {
+    QueueType_CmdStr=0,                         // command string (without the terminator)
+    QueueType_Color,                            // hue (2 bytes) and whiteness
+    QueueType_Count,                            // pixel count percentage
+    QueueType_Force,                            // force (2 bytes) and time (4 bytes)
+    QueueType_Skip,                             // unused bytes, so that a command string doesn't wrap
+  };
+
+  byte cmdQueue[COMMAND_QUEUE_SIZE];            // ring of calls: type, length, then the values
+  volatile byte cmdQueueHead = 0;               // free-running index of the oldest call (consumer)
+  volatile byte cmdQueueTail = 0;               // free-running index past the newest call (producer)
+  uint16_t queueDropped = 0;                    // number of calls dropped when it was full
+  Status queueStatus = Status_Success;          // status of last queued command string that failed
+  #endif
+
+  typedef struct // 24 bytes
+  {
+    PluginLayer *pluginLayers;                  // layer stack for this pattern
+    PluginTrack *pluginTracks;                  // track stack for this pattern
+    short indexLayerStack;                      // saved stack indices when not active
+    short indexTrackStack;
+    short indexTrackEnable;
+    uint16_t segOffset, segCount;               // saved segment settings when not active
+    uint16_t patternId;                         // identifies the pattern (MAX_WORD_VALUE if none)
+    uint32_t lastUse;                           // value of 'patternUses' when last switched to
+    uint32_t memBytes;                          // memory used by plugins and pixel buffers
+  }
+  PatternSlot; // defines each pattern in the cache
+
+  PatternSlot *patternSlots = NULL;             // cached patterns (NULL if not caching)
+  byte numPatternSlots = 0;                     // number of patterns that can be cached
+  byte activePatternSlot = 0;                   // index of the pattern currently displayed
+  uint32_t patternUses = 0;                     // incremented on every pattern switch
+  uint32_t patternMaxBytes = 0;                 // memory limit for cached patterns (0 for none)
+
+  uint32_t memUsed = 0;                         // memory used by all patterns (plugins and buffers)
+  uint32_t memPeak = 0;                         // largest value of 'memUsed' (since last reset)
+
+  byte framesPerSec = 0;                        // target frame rate (0 if not pacing frames)
+  FramePolicy framePolicy = FramePolicy_DropSteps; // how to handle tracks that fall behind
+  uint16_t msecsPerFrame = 0;                   // time between frames (0 if not pacing frames)
+  uint32_t timeNextFrame = 0;                   // time of next frame boundary in msecs
+
+  enum LoopState
+  {
+    LoopState_Disabled=0,                       // loop playback is not enabled
+    LoopState_Failed,                           // loop didn't fit: not searching until effects change
+    LoopState_Searching,                        // recording frames while looking for a loop
+    LoopState_Playing,                          // playing back the recorded loop
+  };
+
+  byte loopState = LoopState_Disabled;          // current state of loop playback
+  bool loopHaveRef = false;                     // true if have a reference state to compare with
+  byte *pLoopBuff = NULL;                       // recording of the changes in each frame of the loop
+  byte *pLoopPixels = NULL;                     // pixels of the previous frame (while searching)
+  byte *pLoopStates = NULL;                     // reference state, followed by the current state
+  uint32_t loopMaxBytes = 0;                    // size of the recording buffer
+  uint32_t loopStateLen = 0;                    // length of each of those states
+  uint16_t loopMaxFrames = 0;                   // longest loop searched for (0 for no limit)
+  uint32_t loopBytes = 0;                       // number of bytes recorded
+  uint32_t loopOffset = 0;                      // offset of next frame to be played back
+  uint32_t loopFrames = 0;                      // frames recorded since the reference state
+  uint32_t loopPower = 0;                       // frames before replacing the reference state
+  uint32_t loopPlayed = 0;                      // frames played since the start of the loop
+  uint32_t loopTimePrev = 0;                    // time of previous frame in msecs
+  uint32_t loopTimeStart = 0;                   // time the current loop was started
+  uint32_t loopTimeNext = 0;                    // time of next frame to be played back
+
+  PixelRange *pChangeRanges = NULL;             // ranges of pixels changed in the latest frame
+  byte maxChangeRanges = 0;                     // max number of ranges (0 if not enabled)
+  byte numChangeRanges = 0;                     // number of ranges in the latest frame
+  byte *pShownPixels = NULL;                    // copy of the pixels of the previous frame shown
+  bool shownPixelsValid = false;                // false if no frame has been shown yet
+
+  typedef struct // 16 bytes
+  {
+    byte *pPixels;                              // output pixels (3 bytes each)
+    uint16_t first, count;                      // range of display pixels copied to the output
+    byte index[3];                              // output index for each of the display values
+    byte factor;                                // brightness factor (0-MAX_BYTE_VALUE)
+    bool goUpwards;                             // false to copy the pixels in reverse
+  }
+  PixelOutput; // defines each output added with 'addOutput()'
+
+  PixelOutput *pOutputs = NULL;                 // additional outputs (NULL if none)
+  byte numOutputs = 0;                          // number of outputs
+
   uint16_t firstPixel = 0;                      // offset to the start of the drawing array
   bool goUpwards = true;                        // true to draw from start to end, else reverse
   
@@ -178,18 +485,54 @@ protected:
   short externDegreeHue;                        // externally set values property values
   byte externPcentWhite;
   byte externPcentCount;
+  byte propsPending = 0;                        // ExtControlBit_ bits for values not yet applied
+  uint32_t propsCoalesced = 0;                  // number of values replaced before being applied
 
   void SetPropColor(void);
   void SetPropCount(void);
   void RestorePropVals(PluginTrack *pTrack, uint16_t pixCount, uint16_t degreeHue, byte pcentWhite);
+  void ApplyProps(void);
 
   // allow extending/overriding for more advanced layer/track handling
   virtual Status NewPluginLayer(int plugin, int segnum, int start, int end);
+  void FreeStack(void);
+  Status LoadStack(const byte *pbuff, uint32_t len, byte numlayers, byte numtracks);
+
+  uint32_t StackBytes(void);
+  uint32_t PluginBytes(int plugin, PixelNutPlugin *pPlugin, uint16_t pixlen);
+  void UpdateMemory(void);
+  void SelectPattern(byte slot);
+  void EvictPattern(byte slot);
+  void ClearPatternCache(void);
 
   void CheckAutoTrigger(bool rollover);
+  void BuildRoutes(void);
+  void SendTriggers(void);
+  bool RouteCycle(int layer, int source);
+  bool TimedTrack(int track);
+  void StepTrack(int track, PluginTrack *pTrack, uint16_t msecs);
+
+  bool LoopRepeatable(void);
+  void SaveLoopState(byte *pbuff, uint32_t time);
+  void RecordLoop(uint32_t time);
+  bool PlayLoop(uint32_t time);
+  void StopLoop(void);
+  void FindChanges(void);
+  bool QueuePut(byte type, const byte *pvals, const char *pstr, byte len);
+  void QueueDrain(uint32_t time);
+  bool QueueWaiting(uint32_t time, uint32_t *pnext);
+  void ShowOutputs(void);
+  void Init(byte *ptr_pixels, uint16_t num_pixels, uint16_t first_pixel, bool goupwards,
+            short num_layers, short num_tracks, byte *pmemory);
+  PixelNutFactory *Factory(void);
+  PixelNutPlugin *MakePlugin(int plugin);
+  void FreePlugin(PixelNutPlugin *pPlugin);
+  byte *AllocTrackBuff(int track, int numbytes);
+  void FreeTrackBuff(byte *pbuff);
 };
 
-class PluginFactory
+class PluginFactory : public PixelNutFactory
 {
-  public: virtual PixelNutPlugin *makePlugin(int plugin);
+  public: virtual PixelNutPlugin *makePlugin(int plugin); // all of the library plugins
+          virtual uint16_t sizePlugin(int plugin);
 };
@@ -0,0 +1,71 @@
+// PixelNut Packets Class Definition
+// Slices the pixels into the packets of a pixel-over-network protocol (E1.31 or DDP),
+// for sending to network controllers, with only the packets whose pixels have changed
+// being sent each frame. The packets are allocated once, and sending them is left to the
+// application (as UDP datagrams to the controller: port 5568 for E1.31, 4048 for DDP).
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+#define E131_PORT               5568    // UDP port for E1.31 (sACN)
+#define E131_HEADER_BYTES       126     // bytes before the pixel values in each packet
+#define E131_UNIVERSE_PIXELS    170     // pixels in each universe (3 bytes each, of 512 max)
+
+#define DDP_PORT                4048    // UDP port for DDP
+#define DDP_HEADER_BYTES        10      // bytes before the pixel values in each packet
+#define DDP_PACKET_PIXELS       480     // pixels in each packet (1440 bytes of data)
+
+class PixelNutPackets
+{
+public:
+
+  enum Protocol
+  {
+    Protocol_E131=0,            // E1.31 (streaming ACN): each packet is a DMX universe
+    Protocol_DDP,               // Distributed Display Protocol: packets are offsets into the display
+  };
+
+  // Constructor: allocates the packets needed for 'num_pixels', which for E1.31 are sent to
+  // consecutive universes starting with 'first_universe' (1..63999), identified by 'name'
+  // (up to 63 characters) and the 16 byte 'cid' (if not NULL, else all zeros), which should be
+  // unique to each source. The universe, name, and cid aren't used by DDP.
+  PixelNutPackets(Protocol protocol, uint16_t num_pixels, uint16_t first_universe=1,
+                  const char *name="PixelNut", const byte *cid=NULL);
+
+  ~PixelNutPackets();
+
+  // Fills the packets from the 'pixels' (3 bytes each), returning the number of packets whose
+  // pixels have changed since the previous call (all of them the first time, or if 'sendall'
+  // is set), which are then retrieved with 'getPacket()'. Receivers may expect packets to be
+  // repeated periodically even if nothing has changed, which can be done with 'sendall'.
+  uint16_t makePackets(const byte *pixels, bool sendall=false);
+
+  // Returns the 'index'th packet (0...count-1) of those to be sent, as returned by 'makePackets()',
+  // with its length in bytes set into 'plen', or NULL if there aren't that many. Each packet's
+  // sequence number is advanced each time it's made to be sent.
+  byte *getPacket(uint16_t index, uint16_t *plen);
+
+  uint16_t getNumPackets() { return numPackets; } // total number of packets for all pixels
+
+  // Note: test this for NULL after constructor to check if successful!
+  byte *pPackets;               // all the packets, one after the other
+
+private:
+
+  Protocol protocol;
+  uint16_t numPixels;
+  uint16_t numPackets;          // number of packets for all the pixels
+  uint16_t packetPixels;        // max pixels in each packet
+  uint16_t headerBytes;         // bytes of header before the pixel values
+  uint16_t packetBytes;         // bytes allocated for each packet
+  uint16_t *pSendIndex;         // indices of packets to be sent
+  uint16_t numSend;             // number of them
+  byte sequence;                // sequence number for next DDP packet
+
+  void InitE131(byte *packet, uint16_t universe, uint16_t pixcount, const char *name, const byte *cid);
+  void InitDDP(byte *packet, uint32_t offset, uint16_t pixcount);
+};
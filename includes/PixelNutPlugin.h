@@ -17,16 +17,52 @@
 #define PLUGIN_TYPE_PREDRAW       0x02  // alters effect settings before drawing
 
                                         // any combination of these is valid:
+#define PLUGIN_TYPE_TIMESTEP      0x04  // timedstep() advances by the elapsed time
 #define PLUGIN_TYPE_DIRECTION     0x08  // changing direction changes effect
 #define PLUGIN_TYPE_TRIGGER       0x10  // triggering changes the effect
 #define PLUGIN_TYPE_USEFORCE      0x20  // trigger force is used in effect
 #define PLUGIN_TYPE_NEGFORCE      0x40  // negative trigger force is used
 #define PLUGIN_TYPE_SENDFORCE     0x80  // sends trigger force to other plugins
 
+// Saves or loads the state of a plugin one value at a time, in the same order for both, so that
+// the saved state doesn't depend on how the compiler lays out the plugin class (padding, the
+// table of virtual methods). Values are kept in memory order, which is little endian with IEEE
+// floats on all of the supported processors, so the members used must be types that are the
+// same size everywhere (byte, bool, int8_t..uint32_t, short, float, or arrays of them: not int,
+// long, or double). Pointers cannot be saved: plugins must save what they point to themselves.
+class PluginState
+{
+public:
+  // save (or count if NULL)
+  PluginState(byte *pbuff) : pBuff(pbuff), pLoad(NULL), maxLen(0), offset(0), loading(false) {}
+  // load
+  PluginState(const byte *pbuff, uint16_t len) : pBuff(NULL), pLoad(pbuff), maxLen(len), offset(0), loading(true) {}
+
+  template <typename T> void value(T &val)
+  {
+    if (loading)
+    {
+      if ((offset + sizeof(T)) <= maxLen) memcpy(&val, (pLoad + offset), sizeof(T));
+    }
+    else if (pBuff != NULL) memcpy((pBuff + offset), &val, sizeof(T));
+
+    offset += sizeof(T);
+  }
+  template <typename T> void value(T *&ptr) = delete; // pointers cannot be saved
+
+  uint16_t length(void) { return offset; } // number of bytes saved/loaded so far
+
+private:
+  byte *pBuff;
+  const byte *pLoad;
+  uint16_t maxLen, offset;
+  bool loading;
+};
+
 class PixelNutPlugin
 {
 public:
-  virtual ~PixelNutPlugin() = 0; // an empty default method is provided
+  virtual ~PixelNutPlugin() = 0; // an empty default method is provided (below)
 
   // Returns capability bits indicating how this plugin affects pixel values.
   // This is the only required method that must be implemented in each plugin.
@@ -44,4 +80,88 @@ public:
   // Perform the next step of an effect by this plugin using the current drawing
   // properties. The rate at which this is called depends on the delay property.
   virtual void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw) {}
+
+  // Perform the next step of an effect, advancing it in proportion to the "msecs" that have
+  // elapsed since the previous step, as if nextstep() had been called at the rate set by the
+  // delay property. Only called if PLUGIN_TYPE_TIMESTEP is set, when the engine is catching up
+  // to a track that has fallen behind: use 'stepsElapsed()' to convert the time into steps.
+  virtual void timedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint16_t msecs)
+    { nextstep(handle, pdraw); }
+
+  // Saves the internal state of this plugin into 'pbuff' (if not NULL), returning the number of
+  // bytes that it takes. Returns 0 if the state cannot be saved, in which case the plugin will be
+  // restarted with begin() when the engine state is restored. By default saves the member
+  // variables listed by 'members()' (below), so this is only overriden for any other state.
+  virtual uint16_t savestate(byte *pbuff) { return SaveMembers(pbuff); }
+
+  // Restores the internal state saved with savestate() instead of calling begin(), with the same
+  // arguments. Returns false if the state could not be restored (without any allocated memory),
+  // and begin() is then called instead. By default loads the members saved by default above.
+  virtual bool loadstate(byte id, uint16_t pixlen, const byte *pbuff, uint16_t len)
+    { return LoadMembers(pbuff, len); }
+
+  // Returns true if the effect depends only on its saved state and the drawing properties (and not
+  // on random numbers), such that once the engine state repeats, the effect repeats exactly too,
+  // allowing it to be played back from a recording (see 'setLoopPlayback()'). By default this is
+  // true for plugins that can save their state: plugins without any state must override this.
+  virtual bool repeatable(void) { return (savestate(NULL) > 0); }
+
+  // Returns true for a drawing plugin that only ever draws with the track's current color (or
+  // black), at some brightness, and redraws all of its pixels in each step, so that its track
+  // buffer only needs a single intensity byte for each pixel instead of three, which is then
+  // colored when the track is combined into the display. Must always return the same value.
+  virtual bool intensityonly(void) { return false; }
+
+  // Returns the number of bytes that begin() allocates for "pixlen" pixels (not including the
+  // plugin object itself), used by the engine to account for the memory used by each pattern.
+  // Must be overriden by any plugin that allocates memory. Once started, this should be what
+  // was actually allocated, and before that the most that begin() would allocate.
+  virtual uint16_t memsize(uint16_t pixlen) { return 0; }
+
+protected:
+
+  // Used to implement the above for plugins that keep all of their state in member variables:
+  // 'members()' lists each of them (but not pointers) with 'state.value()', which is then used
+  // both to save them and to load them back in the same order (see 'PluginState'). Plugins that
+  // don't list any have no state to save, and are restarted with begin() instead.
+  uint16_t SaveMembers(byte *pbuff)
+  {
+    PluginState state(pbuff);
+    members(state);
+    return state.length();
+  }
+
+  bool LoadMembers(const byte *pbuff, uint16_t len)
+  {
+    PluginState count(NULL);
+    members(count);
+    if (len != count.length()) return false; // not from this plugin (or this version of it)
+
+    PluginState state(pbuff, len);
+    members(state);
+    return true;
+  }
+
+  virtual void members(PluginState &state) {}
+};
+
+// defined here (and not with the plugins) so that using any one plugin doesn't link in all of them
+inline PixelNutPlugin::~PixelNutPlugin() {}
+
+// Interface used by the engine to create plugins from the numbers used in the 'E' command:
+// implemented by the 'PluginFactory' class with all of the library plugins, or by a
+// 'PluginRegistry' with just those that an application lists (see 'PluginRegistry.h').
+class PixelNutFactory
+{
+public:
+  virtual ~PixelNutFactory() {} // so a factory can be deleted through this interface
+
+  // Returns a new instance of the plugin for 'plugin', or NULL if there isn't one.
+  virtual PixelNutPlugin *makePlugin(int plugin) = 0;
+
+  // Deletes a plugin that was returned by makePlugin().
+  virtual void freePlugin(PixelNutPlugin *pPlugin) { delete pPlugin; }
+
+  // Returns the number of bytes used by an instance of the plugin for 'plugin' (0 if not known).
+  virtual uint16_t sizePlugin(int plugin) { return 0; }
 };
@@ -0,0 +1,91 @@
+// PixelNut Static Engine Template
+// An engine for a pattern that is fixed when the application is built, with all of its layer and
+// track stacks, and the pixel buffers for the tracks, in static memory instead of on the heap.
+// The number of layers and tracks can be counted from the pattern itself at compile time:
+//
+//    #define MY_PATTERN "E10 B50 D60 T E101 T E120 F250 T G"
+//
+//    PixelNutStatic<PIXEL_COUNT, PatternLayers(MY_PATTERN), PatternTracks(MY_PATTERN)>
+//      pixelNutEngine(pPixelData);
+//
+//    char myPattern[] = MY_PATTERN; // execCmdStr() modifies the string
+//
+// Use this with a 'StaticPluginRegistry' (see 'PluginRegistry.h') to create the plugins in
+// static memory too (with 'PNP_TwinkleStatic' instead of 'PNP_Twinkle', which allocates memory,
+// as do the comet effects). Patterns cannot be cached with 'setPatternCache()' with this engine.
+//
+// Instead of parsing the pattern and starting its effects at power-on, the state of the pattern
+// just started can be made on a host computer with the 'pnpreset' tool (see 'extras/hosttools'),
+// which writes it as a header with a byte array, along with the numbers of pixels/layers/tracks:
+//
+//    pnpreset myPreset 60 "E10 B50 D60 T E101 T E120 F250 T G" > MyPreset.h
+//
+//    #include "MyPreset.h"
+//
+//    PixelNutStatic<MYPRESET_PIXELS, MYPRESET_LAYERS, MYPRESET_TRACKS> pixelNutEngine(pPixelData);
+//
+// then in setup():
+//
+//    if (pixelNutEngine.loadPreset(myPreset) != PixelNutEngine::Status_Success)
+//    {
+//      char pattern[sizeof(MYPRESET_PATTERN)]; // execCmdStr() modifies the string
+//      strcpy_P(pattern, PSTR(MYPRESET_PATTERN));
+//      pixelNutEngine.execCmdStr(pattern); // the preset is out of date: start the pattern instead
+//    }
+//
+// The preset is in program memory. On AVR it's copied onto the stack while it's loaded (it has no
+// pixels, so it's small: 136 bytes for the pattern above), and so takes no RAM afterwards. It
+// includes the engine settings (brightness, delay, first pixel, direction), which are those of a
+// new engine: change them after it's loaded. It must be made again whenever the format of the
+// saved engine or plugin states changes, until then 'loadPreset()' returns Status_Error_BadVal.
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+// returns the value of the number at 'str' (0 if none)
+constexpr int PatternNumber(const char *str, int value=0)
+{
+  return (((*str >= '0') && (*str <= '9')) ? PatternNumber((str+1), ((value * 10) + (*str - '0'))) : value);
+}
+
+// returns the number of layers created by a pattern: one for each 'E' command
+constexpr short PatternLayers(const char *str)
+{
+  return (!*str ? 0 : ((((*str == 'E') || (*str == 'e')) ? 1 : 0) + PatternLayers(str+1)));
+}
+
+// returns the number of tracks created by a pattern: one for each drawing effect, which are the
+// plugins numbered below 100 (as assigned in 'PluginFactory.cpp')
+constexpr short PatternTracks(const char *str)
+{
+  return (!*str ? 0 : ((((*str == 'E') || (*str == 'e')) && (PatternNumber(str+1) < 100)) ? 1 : 0) +
+                      PatternTracks(str+1));
+}
+
+template <uint16_t PIXELS, short LAYERS=4, short TRACKS=3>
+class PixelNutStatic : public PixelNutEngine
+{
+public:
+  PixelNutStatic(byte *ptr_pixels, uint16_t first_pixel=0, bool goupwards=true)
+    : PixelNutEngine(ptr_pixels, PIXELS, first_pixel, goupwards, LAYERS, TRACKS, (byte*)staticMemory) {}
+
+  // Replaces all effects with a preset made by the 'pnpreset' tool (see above).
+  template <uint32_t LEN> Status loadPreset(const byte (&preset)[LEN])
+  {
+    #if defined(__AVR__) // program memory cannot be read directly
+    byte state[LEN];
+    memcpy_P(state, preset, LEN);
+    return loadState(state, LEN);
+    #else
+    return loadState(preset, LEN);
+    #endif
+  }
+
+private:
+  // in words to keep the stacks aligned
+  uint32_t staticMemory[(StaticBytes(PIXELS, LAYERS, TRACKS) + 3) / 4];
+};
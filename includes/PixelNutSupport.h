@@ -20,6 +20,7 @@
 // useful physical constants:
 #define PI_VALUE            (3.1415)
 #define RADIANS_PER_WAVE    (2 * PI_VALUE)  // radians in a circle
+#define PHASE_PER_WAVE      (4294840626UL)  // RADIANS_PER_WAVE as a 'waveValue()' phase (not quite 2^32)
 
 // maximum values for properties:
 #define MAX_BYTE_VALUE            255     // max value in 8 bits (unsigned)
@@ -32,6 +33,8 @@
 #define MAX_FORCE_VALUE           1000    // max value for force
 #define MAX_PLUGIN_VALUE          32000   // max value for plugin
 
+#define COLOR_CACHE_SIZE          16      // colors remembered by makeColorVals() (power of 2, or 0)
+
 typedef void* PixelNutHandle;   // context to call methods with
 
 typedef uint32_t (*GetMsecsTime)(void);
@@ -50,6 +53,9 @@ public:
   // APA102 pixels are ordered BGR, array [2,1,0]
   PixelNutSupport(GetMsecsTime get_msecs, PixelValOrder *pix_order); // constructor
 
+  // returns the ordering of the pixel values set in the constructor
+  PixelValOrder *getPixelOrder(void);
+
   /////////////////////////////////////////////////////////////////////////////
   // Optionally set from the main application; used by the PixelNut Engine.
   // The Plugins use the debug message output formating call as well.
@@ -89,13 +95,46 @@ public:
 
   void makeColorVals(DrawProps *pdraw); // performs translation of hue/white/bright to RGB pixel values
 
+  // retrieves the number of times 'makeColorVals()' found the color in its cache or had to create it,
+  // then resets those counts if 'reset' is true (used to determine the best size for the cache)
+  void colorCacheStats(uint32_t *phits, uint32_t *pmisses, bool reset=false);
+
   // abstracts plugins from the direct handling of the pixel values:
+  // (if the plugin draws only intensities (see 'intensityonly()'), each pixel is a single brightness
+  // factor, set from that for 'r,g,b' (which must be the track's color or black), and colored with
+  // the track's color when shown; 'getPixel()' then returns that factor for all three values)
   void movePixels( PixelNutHandle p, uint16_t startpos, uint16_t endpos, uint16_t newpos);    // moves range of pixels
   void clearPixels(PixelNutHandle p, uint16_t startpos, uint16_t endpos);                     // clears range of pixels
+  void scrollPixels(PixelNutHandle p, short count); // moves all pixels by 'count' (wrapping around), in constant time
   void getPixel(   PixelNutHandle p, uint16_t pos, byte *ptr_r, byte *ptr_g, byte *ptr_b);    // gets RGB pixel values
   void setPixel(   PixelNutHandle p, uint16_t pos, byte r, byte g, byte b, float scale=1.0);  // sets RGB pixel values
   void setPixel(   PixelNutHandle p, uint16_t pos, float scale); // scales existing value without applying gamma correction
 
+  // returns the gamma corrected brightness factor (0-MAX_BYTE_VALUE) that 'setPixel()' applies for 'scale',
+  // then sets 'count' pixels from 'pos' going down (wrapping around from 0 to 'pixlen'-1) using such factors
+  byte makeBrightFactor(PixelNutHandle p, float scale);
+  void setPixelRamp(PixelNutHandle p, uint16_t pos, uint16_t count, uint16_t pixlen,
+                    byte r, byte g, byte b, byte *pfactors);
+
+  // creates a table of 'count' pixel values (3 bytes each) from the color scaled by each of the
+  // brightness factors, then sets 'count' pixels from 'pos' going up, with 'plevels' holding the
+  // index into that table for each pixel (faster than 'setPixel()' if only a few levels are used);
+  // if drawing only intensities, the table passed to 'setPixelVals()' is just the factors instead
+  void makePixelVals(byte r, byte g, byte b, byte *pfactors, uint16_t count, byte *pvals);
+  void setPixelVals(PixelNutHandle p, uint16_t pos, uint16_t count, byte *plevels, byte *pvals);
+
+  // returns the gamma corrected value of a brightness value (0-MAX_BYTE_VALUE)
+  byte gammaCorrect(byte value);
+
+  // returns the value of a cosine wave, as (cos+1)/2 scaled to 0-65535 with 8 bits of fraction
+  // (0-0xFFFF00), for a 'phase' where the full range of 32 bits is one wave (uses a table, so
+  // is much faster than 'cos()', and is within 1/65535 of it)
+  uint32_t waveValue(uint32_t phase);
+
+  // returns the number of steps (in 1/256 units) that 'msecs' of elapsed time corresponds to,
+  // using the same delay between steps as the engine (used by plugins in timedstep())
+  uint32_t stepsElapsed(PixelNutHandle p, DrawProps *pdraw, uint16_t msecs);
+
   // utility functions to map and clip values into/over a range of values
   long mapValue(long inval, long in_min, long in_max, long out_min, long out_max);
   long clipValue(long inval, long out_min, long out_max);
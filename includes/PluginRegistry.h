@@ -0,0 +1,128 @@
+// PixelNut Plugin Registry Template
+// A plugin factory made at compile time from a list of just the plugins an application uses,
+// instead of the 'PluginFactory' class that creates any of the library plugins, so that the
+// code for all of the other plugins is never linked into the application. For example:
+//
+//    #include "plugins/PNP_DrawAll.h"
+//    #include "plugins/PNP_HueRotate.h"
+//
+//    PluginRegistry< PluginEntry<0,   PNP_DrawAll>,
+//                    PluginEntry<101, PNP_HueRotate> > pluginRegistry;
+//
+//    PluginFactory *pPluginFactory = NULL; // not used (but must still be defined)
+//
+// then in setup(): pixelNutEngine.setPluginFactory(&pluginRegistry);
+//
+// The plugin numbers are those used in the 'E' command, which should be the same as assigned
+// in 'PluginFactory.cpp' so that patterns work the same with either one.
+//
+// A 'StaticPluginRegistry<SLOTS, ...>' works the same way, but creates the plugins in static
+// memory instead of with 'new', for up to SLOTS plugins at once (the number of layers).
+//
+// The engine still calls the plugins through their virtual methods: calling nextstep() and
+// timedstep() through a switch on the plugin number instead (with non-virtual calls that the
+// compiler can inline) made no difference on a host build, as almost all of the time in each
+// step is spent drawing the pixels, not in the call itself.
+/*
+    Copyright (c) 2015-2021, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+// Creates an object in memory that is already there, like the standard placement new, which
+// isn't available with some Arduino cores (the tag keeps it from clashing with that one).
+struct PluginSlotTag {};
+inline void *operator new(size_t size, void *pmem, PluginSlotTag) { return pmem; }
+inline void operator delete(void *ptr, void *pmem, PluginSlotTag) {}
+
+// Associates the plugin number 'N' with the plugin class 'P' in the registry.
+template <int N, class P> struct PluginEntry
+{
+  static PixelNutPlugin *make(int plugin) { return ((plugin == N) ? new P : NULL); }
+  static PixelNutPlugin *make(int plugin, void *pmem) { return ((plugin == N) ? new (pmem, PluginSlotTag()) P : NULL); }
+  static uint16_t bytes(int plugin) { return ((plugin == N) ? sizeof(P) : 0); }
+  enum { size = sizeof(P) };
+};
+
+// Finds the size of the largest plugin class in the entries.
+template <class... Entries> struct PluginMaxSize;
+template <class E> struct PluginMaxSize<E> { enum { size = E::size }; };
+template <class E, class Next, class... Rest> struct PluginMaxSize<E, Next, Rest...>
+{
+  enum { size = (((int)E::size > (int)PluginMaxSize<Next, Rest...>::size) ? (int)E::size :
+                                                                         (int)PluginMaxSize<Next, Rest...>::size) };
+};
+
+template <class... Entries> class PluginRegistry : public PixelNutFactory
+{
+public:
+  PixelNutPlugin *makePlugin(int plugin) { return Make<Entries...>(plugin); }
+  uint16_t sizePlugin(int plugin) { return Size<Entries...>(plugin); }
+
+private:
+  // expands into a comparison with the number of each entry in turn
+  template <class E> static PixelNutPlugin *Make(int plugin) { return E::make(plugin); }
+
+  template <class E, class Next, class... Rest> static PixelNutPlugin *Make(int plugin)
+  {
+    PixelNutPlugin *pPlugin = E::make(plugin);
+    return ((pPlugin != NULL) ? pPlugin : Make<Next, Rest...>(plugin));
+  }
+
+  template <class E> static uint16_t Size(int plugin) { return E::bytes(plugin); }
+
+  template <class E, class Next, class... Rest> static uint16_t Size(int plugin)
+  {
+    uint16_t size = E::bytes(plugin);
+    return (size ? size : Size<Next, Rest...>(plugin));
+  }
+};
+
+template <byte SLOTS, class... Entries> class StaticPluginRegistry : public PixelNutFactory
+{
+public:
+  PixelNutPlugin *makePlugin(int plugin)
+  {
+    for (byte i = 0; i < SLOTS; ++i)
+    {
+      if (slotUsed[i]) continue;
+
+      PixelNutPlugin *pPlugin = Make<Entries...>(plugin, slotMemory[i]);
+      if (pPlugin != NULL) slotUsed[i] = true;
+      return pPlugin;
+    }
+    return NULL; // all slots are in use
+  }
+
+  void freePlugin(PixelNutPlugin *pPlugin)
+  {
+    if (pPlugin == NULL) return;
+
+    pPlugin->~PixelNutPlugin();
+    slotUsed[((word_t*)(void*)pPlugin - slotMemory[0]) / SLOT_WORDS] = false;
+  }
+
+  // all plugins take up a whole slot (the memory for which is always used)
+  uint16_t sizePlugin(int plugin)
+  {
+    return (PluginRegistry<Entries...>().sizePlugin(plugin) ? (SLOT_WORDS * sizeof(word_t)) : 0);
+  }
+
+private:
+  typedef void *word_t; // plugins are aligned to pointers (such as their table of virtual methods)
+
+  enum { SLOT_WORDS = (PluginMaxSize<Entries...>::size + sizeof(word_t) - 1) / sizeof(word_t) };
+
+  word_t slotMemory[SLOTS][SLOT_WORDS]; // each slot can hold the largest of the plugins
+  bool slotUsed[SLOTS] = {};
+
+  template <class E> static PixelNutPlugin *Make(int plugin, void *pmem) { return E::make(plugin, pmem); }
+
+  template <class E, class Next, class... Rest> static PixelNutPlugin *Make(int plugin, void *pmem)
+  {
+    PixelNutPlugin *pPlugin = E::make(plugin, pmem);
+    return ((pPlugin != NULL) ? pPlugin : Make<Next, Rest...>(plugin, pmem));
+  }
+};
@@ -55,6 +55,10 @@ public:
     }
   }
 
+  bool repeatable(void) { return false; } // random pixels are drawn on each step
+
 private:
+  void members(PluginState &state) { state.value(pixLength); }
+
   uint16_t pixLength;
 };
@@ -105,6 +105,16 @@ public:
   }
 
 private:
+  void members(PluginState &state)
+  {
+    state.value(myid);
+    state.value(forceVal);
+    state.value(goForward);
+    state.value(pixLength);
+    state.value(lastCount);
+    state.value(headPos);
+  }
+
   byte myid;
   short forceVal;
   bool goForward;
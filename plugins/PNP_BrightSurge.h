@@ -77,6 +77,8 @@ public:
   }
 
 private:
+  void members(PluginState &state) { state.value(minBright); state.value(stepCount); }
+
   uint16_t minBright;
   uint16_t stepCount;
 };
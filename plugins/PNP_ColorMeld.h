@@ -100,6 +100,17 @@ public:
   }
 
 private:
+  void members(PluginState &state)
+  {
+    state.value(myid);
+    state.value(forceVal);
+    state.value(curHue);
+    state.value(curWhite);
+    state.value(endHue);
+    state.value(endWhite);
+    state.value(stepWhite);
+  }
+
   byte myid;
   short forceVal;
   int16_t curHue, curWhite;
@@ -1,6 +1,6 @@
 // What Effect Does:
 //
-//    Using the built-in comet handling functions, creates one or more comets (up to 12),
+//    Using the built-in comet handling functions, creates one or more comets (one for every 8 pixels),
 //    such that they either loop around the drawing window continuously, or disappear as 
 //    they "fall off" of the end of the window.
 //
@@ -29,6 +29,10 @@
 //
 //    Advances all of the comets currently created by one pixel.
 //
+// Calling timedstep():
+//
+//    Advances all of the comets by the number of whole steps the elapsed time corresponds to.
+//
 // Properties Used:
 //
 //   degreeHue, pcentWhite - determines the color of the comet body.
@@ -45,13 +49,15 @@
 class PNP_CometHeads : public PixelNutPlugin
 {
 public:
+  PNP_CometHeads() : maxHeads(MAX_WORD_VALUE), cdata(NULL) {}
   ~PNP_CometHeads() { pixelNutComets.cometHeadDelete(cdata); }
 
   byte gettype(void) const
   {
     return PLUGIN_TYPE_REDRAW   | PLUGIN_TYPE_DIRECTION |
            PLUGIN_TYPE_TRIGGER  | PLUGIN_TYPE_NEGFORCE  |
-           PLUGIN_TYPE_USEFORCE | PLUGIN_TYPE_SENDFORCE;
+           PLUGIN_TYPE_USEFORCE | PLUGIN_TYPE_SENDFORCE |
+           PLUGIN_TYPE_TIMESTEP;
   };
 
   void begin(byte id, uint16_t pixlen)
@@ -59,18 +65,32 @@ public:
     pixLength = pixlen;
     myid = id;
 
-    uint16_t maxheads = pixLength / 8; // one head for every 8 pixels up to 12
+    uint16_t maxheads = pixLength / 8; // one head for every 8 pixels
     if (maxheads < 1) maxheads = 1; // but at least one
-    else if (maxheads > 12) maxheads = 12;
 
-    cdata = pixelNutComets.cometHeadCreate(maxheads);
-    if ((cdata == NULL) && (maxheads > 1)) // try for at least 1
-      cdata = pixelNutComets.cometHeadCreate(1);
+    // use fewer heads if not enough memory, down to just 1
+    while (((cdata = pixelNutComets.cometHeadCreate(maxheads)) == NULL) && (maxheads > 1))
+      maxheads /= 2;
+
+    maxHeads = pixelNutComets.cometHeadCount(cdata); // what was actually allocated
 
     //pixelNutSupport.msgFormat(F("CometHeads: maxheads=%d cdata=0x%08X"), maxheads, cdata);
 
     headCount = 0; // no heads drawn yet
     firstime = true;
+    stepFrac = 0;
+  }
+
+  // Once started, reports the heads actually allocated, which can be fewer when memory is short.
+  // Before that (as for 'estimatePatternMemory()'), this is the most that begin() could allocate.
+  uint16_t memsize(uint16_t pixlen)
+  {
+    if (maxHeads != MAX_WORD_VALUE) // started
+      return ((cdata != NULL) ? pixelNutComets.cometHeadBytes(maxHeads, pixlen) : 0);
+
+    uint16_t maxheads = pixlen / 8; // same as in begin()
+    if (maxheads < 1) maxheads = 1;
+    return pixelNutComets.cometHeadBytes(maxheads, pixlen);
   }
 
   void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
@@ -99,6 +119,15 @@ public:
     forceVal = force;
   }
 
+  void timedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint16_t msecs)
+  {
+    uint32_t steps = pixelNutSupport.stepsElapsed(handle, pdraw, msecs) + stepFrac;
+    stepFrac = steps & 0xFF; // keep fraction for next time
+
+    // each step must be drawn to erase the end of the tails
+    for (steps >>= 8; steps > 0; --steps) nextstep(handle, pdraw);
+  }
+
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
     int count = pixelNutComets.cometHeadDraw(cdata, myid, pdraw, handle, pixLength);
@@ -109,10 +138,40 @@ public:
     }
   }
 
+  uint16_t savestate(byte *pbuff)
+  {
+    uint16_t len = SaveMembers(pbuff);
+    uint16_t clen = pixelNutComets.cometHeadSave(cdata, ((pbuff != NULL) ? (pbuff + len) : NULL));
+    return (clen ? (len + clen) : 0);
+  }
+
+  bool loadstate(byte id, uint16_t pixlen, const byte *pbuff, uint16_t len)
+  {
+    uint16_t mlen = SaveMembers(NULL);
+    if ((len <= mlen) || !LoadMembers(pbuff, mlen)) return false;
+
+    cdata = pixelNutComets.cometHeadLoad((pbuff + mlen), (len - mlen));
+    maxHeads = pixelNutComets.cometHeadCount(cdata); // whatever was saved
+    return (cdata != NULL);
+  }
+
 private:
+  void members(PluginState &state)
+  {
+    state.value(myid);
+    state.value(firstime);
+    state.value(repMode);
+    state.value(stepFrac);
+    state.value(forceVal);
+    state.value(pixLength);
+    state.value(headCount);
+  }
+
   byte myid;
   bool firstime, repMode;
+  byte stepFrac;
   short forceVal;
   uint16_t pixLength, headCount;
+  uint16_t maxHeads; // heads allocated, MAX_WORD_VALUE until started
   PixelNutComets::cometData cdata;
 };
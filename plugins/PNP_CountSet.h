@@ -43,5 +43,7 @@ public:
   }
 
 private:
+  void members(PluginState &state) { state.value(pixLength); }
+
   uint16_t pixLength;
 };
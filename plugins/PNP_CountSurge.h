@@ -58,5 +58,12 @@ public:
   }
 
 private:
+  void members(PluginState &state)
+  {
+    state.value(pixLength);
+    state.value(baseCount);
+    state.value(stepCount);
+  }
+
   uint16_t pixLength, baseCount, stepCount;
 };
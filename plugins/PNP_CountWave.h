@@ -27,6 +27,10 @@
 //    value to determine the modulation with a cosine function. The very first time
 //    this is called the median value is set to the current property value.
 //
+// Calling timedstep():
+//
+//    Advances the angle by the number of steps the elapsed time corresponds to.
+//
 // Properties Used:
 //
 //    pixCount - used to set the median pixel count the very first call to nextstep().
@@ -42,7 +46,8 @@ public:
   byte gettype(void) const
   {
     return PLUGIN_TYPE_PREDRAW | PLUGIN_TYPE_TRIGGER  | PLUGIN_TYPE_USEFORCE |
-                                 PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE;
+                                 PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE |
+                                 PLUGIN_TYPE_TIMESTEP;
   };
 
   void begin(byte id, uint16_t pixlen)
@@ -58,6 +63,14 @@ public:
     forceVal = force; // can be negative
   }
 
+  void timedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint16_t msecs)
+  {
+    // advance for the steps beyond this one, which nextstep() then takes
+    uint32_t steps = pixelNutSupport.stepsElapsed(handle, pdraw, msecs);
+    if (steps > 256) AdvanceAngle(handle, pdraw, (float)(steps - 256) / 256);
+    nextstep(handle, pdraw);
+  }
+
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
     if (!baseValue) baseValue = pdraw->pixCount;
@@ -69,21 +82,36 @@ public:
 
     //pixelNutSupport.msgFormat(F("CountWave: count=%d angle(*100)=%d"), pdraw->pixCount, (int)(angleNext*100));
 
-    angleNext += (RADIANS_PER_WAVE / 100) * ((float)forceVal / MAX_FORCE_VALUE);
+    AdvanceAngle(handle, pdraw, 1.0);
+  }
 
-    if (angleNext > RADIANS_PER_WAVE)
+private:
+  void members(PluginState &state)
+  {
+    state.value(myid);
+    state.value(forceVal);
+    state.value(baseValue);
+    state.value(pixLength);
+    state.value(angleNext);
+  }
+
+  // advances the angle by the number of steps, triggering once per wave completed
+  void AdvanceAngle(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, float steps)
+  {
+    angleNext += (RADIANS_PER_WAVE / 100) * ((float)forceVal / MAX_FORCE_VALUE) * steps;
+
+    while (angleNext > RADIANS_PER_WAVE)
     {
       angleNext -= RADIANS_PER_WAVE;
       pixelNutSupport.sendForce(handle, myid, forceVal, pdraw);
     }
-    else if (angleNext < 0)
+    while (angleNext < 0)
     {
       angleNext += RADIANS_PER_WAVE;
       pixelNutSupport.sendForce(handle, myid, forceVal, pdraw);
     }
   }
 
-private:
   byte myid;
   short forceVal, baseValue;
   uint16_t pixLength;
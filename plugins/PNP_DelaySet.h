@@ -36,6 +36,8 @@ public:
     return PLUGIN_TYPE_PREDRAW | PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
   };
 
+  bool repeatable(void) { return true; } // has no state
+
   void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
   {
     force = abs(force);
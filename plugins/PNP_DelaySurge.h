@@ -74,6 +74,8 @@ public:
   }
 
 private:
+  void members(PluginState &state) { state.value(maxDelay); state.value(stepCount); }
+
   uint16_t maxDelay;
   uint16_t stepCount;
 };
@@ -39,6 +39,10 @@ public:
       pixelNutSupport.setPixel(handle, i, pdraw->r, pdraw->g, pdraw->b);
   }
 
+  bool intensityonly(void) { return true; } // all pixels redrawn with the current color
+
 private:
+  void members(PluginState &state) { state.value(pixLength); }
+
   uint16_t pixLength;
 };
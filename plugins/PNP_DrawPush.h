@@ -12,7 +12,9 @@
 //
 // Calling nextstep():
 //
-//    Shifts (pushes) all pixels by one, then draws a single pixel to position 0.
+//    Shifts (pushes) all pixels by one, then draws a single pixel to position 0, so that
+//    whatever is past the end of the drawing window falls off the end. While clearing, only
+//    the cleared pixels are pushed, which overwrite what was drawn instead of moving it.
 //
 // Properties Used:
 //
@@ -50,15 +52,25 @@ public:
     //pixelNutSupport.msgFormat(F("DrawPush: dodraw=%d curpos=%d r=%d g=%d b=%d"),
     //                            dodraw, curPos, pdraw->r, pdraw->g, pdraw->b);
 
-    if (curPos)
+    if (doDraw)
     {
-      uint16_t endpos = (curPos < pixLength-1) ? curPos : curPos-1;
-      pixelNutSupport.movePixels(handle, 0, endpos, 1); // shift down one
+      // shift down one: the pixel that wraps around from the end is then overwritten, and the
+      // pixels past the current position are all dark (cleared in the previous cycle)
+      if (curPos) pixelNutSupport.scrollPixels(handle, 1);
+      pixelNutSupport.setPixel(handle, 0, pdraw->r, pdraw->g, pdraw->b);
+    }
+    else
+    {
+      // only the pixels up to the current position are shifted down while clearing: those are
+      // all dark except the last one, which is pushed ahead of them over what was drawn
+      if (curPos)
+      {
+        uint16_t endpos = (curPos < pixLength-1) ? curPos : curPos-1;
+        pixelNutSupport.movePixels(handle, endpos, endpos, endpos+1);
+        pixelNutSupport.setPixel(handle, endpos, 0,0,0);
+      }
+      pixelNutSupport.setPixel(handle, 0, 0,0,0);
     }
-
-    if (doDraw)
-         pixelNutSupport.setPixel(handle, 0, pdraw->r, pdraw->g, pdraw->b);
-    else pixelNutSupport.setPixel(handle, 0, 0,0,0);
 
     if (curPos < pixLength-1) ++curPos;
 
@@ -77,6 +89,15 @@ public:
   }
 
 private:
+  void members(PluginState &state)
+  {
+    state.value(myid);
+    state.value(doDraw);
+    state.value(forceVal);
+    state.value(pixLength);
+    state.value(curPos);
+  }
+
   byte myid;
   bool doDraw;
   short forceVal;
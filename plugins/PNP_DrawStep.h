@@ -11,6 +11,10 @@
 //
 //    Draws a single pixel each time, wrapping around the strip when the end is reached.
 //
+// Calling timedstep():
+//
+//    Draws as many pixels as the number of whole steps the elapsed time corresponds to.
+//
 // Properties Used:
 //
 //    pcentBright - the brightness.
@@ -26,7 +30,8 @@ class PNP_DrawStep : public PixelNutPlugin
 public:
   byte gettype(void) const
   {
-    return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE | PLUGIN_TYPE_DIRECTION;
+    return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE | PLUGIN_TYPE_DIRECTION |
+           PLUGIN_TYPE_TIMESTEP;
   };
 
   void begin(byte id, uint16_t pixlen)
@@ -34,6 +39,7 @@ public:
     myid = id;
     pixLength = pixlen;
     curPos = 0;
+    stepFrac = 0;
   }
 
   void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
@@ -41,6 +47,14 @@ public:
     forceVal = force;
   }
 
+  void timedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint16_t msecs)
+  {
+    uint32_t steps = pixelNutSupport.stepsElapsed(handle, pdraw, msecs) + stepFrac;
+    stepFrac = steps & 0xFF; // keep fraction for next time
+
+    for (steps >>= 8; steps > 0; --steps) nextstep(handle, pdraw);
+  }
+
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
     //pixelNutSupport.msgFormat(F("DrawStep: curpos=%d, r=%d, g=%d, b=%d"), curPos, pdraw->r, pdraw->g, pdraw->b);
@@ -55,7 +69,16 @@ public:
   }
 
 private:
-  byte myid;
+  void members(PluginState &state)
+  {
+    state.value(myid);
+    state.value(stepFrac);
+    state.value(forceVal);
+    state.value(pixLength);
+    state.value(curPos);
+  }
+
+  byte myid, stepFrac;
   short forceVal;
   uint16_t pixLength, curPos;
 };
@@ -11,6 +11,10 @@
 //
 //    Advances the effect by one pixel, by redrawing all of the pixels.
 //
+// Calling timedstep():
+//
+//    Advances the effect by the number of whole steps the elapsed time corresponds to.
+//
 // Properties Used:
 //
 //    r,g,b - the current color values.
@@ -26,13 +30,29 @@ class PNP_FerrisWheel : public PixelNutPlugin
 public:
   byte gettype(void) const
   {
-    return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION;
+    return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION | PLUGIN_TYPE_TIMESTEP;
   };
 
   void begin(byte id, uint16_t pixlen)
   {
     pixLength = pixlen;
     lastCount = 0;
+    stepFrac = 0;
+  }
+
+  void timedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint16_t msecs)
+  {
+    uint32_t steps = pixelNutSupport.stepsElapsed(handle, pdraw, msecs) + stepFrac;
+    stepFrac = steps & 0xFF; // keep fraction for next time
+    steps >>= 8;
+
+    if (!steps) return; // not enough time for a step
+
+    // rotate the spokes for the steps beyond this one (unless they are being recalculated)
+    if ((--steps > 0) && (lastCount == pdraw->pixCount))
+      spaceCount = (spaceCount + steps) % (spokeSpaces + 1);
+
+    nextstep(handle, pdraw);
   }
 
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
@@ -70,6 +90,18 @@ public:
       spaceCount = 0;
   }
 
+  bool intensityonly(void) { return true; } // all pixels redrawn with the current color
+
 private:
+  void members(PluginState &state)
+  {
+    state.value(stepFrac);
+    state.value(pixLength);
+    state.value(lastCount);
+    state.value(spokeSpaces);
+    state.value(spaceCount);
+  }
+
+  byte stepFrac;
   uint16_t pixLength, lastCount, spokeSpaces, spaceCount;
 };
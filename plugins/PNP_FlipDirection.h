@@ -27,6 +27,8 @@ public:
     return PLUGIN_TYPE_PREDRAW | PLUGIN_TYPE_TRIGGER;
   };
 
+  bool repeatable(void) { return true; } // has no state
+
   void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
   {
     pdraw->goUpwards = !pdraw->goUpwards;
@@ -19,6 +19,11 @@
 //    Sets the current drawing color and then advances the hue by some amount that was
 //    determined by the force in the previous call to trigger().
 //
+// Calling timedstep():
+//
+//    Advances the hue for the number of whole steps the elapsed time corresponds to,
+//    then does the same as nextstep().
+//
 // Properties Used:
 //
 //    percentWhite, percentBright - current values used to create the drawing color.
@@ -33,7 +38,7 @@ class PNP_HueRotate : public PixelNutPlugin
 public:
   byte gettype(void) const
   {
-    return PLUGIN_TYPE_PREDRAW | PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
+    return PLUGIN_TYPE_PREDRAW | PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE | PLUGIN_TYPE_TIMESTEP;
   };
 
   void begin(byte id, uint16_t pixlen)
@@ -43,6 +48,7 @@ public:
     curDegrees = 0.0;       // if trigger() not called then hue will be 0 (red)
     addDegrees = 0.0;       // which will not change until trigger() is called
     doResetAtEnd = false;
+    stepFrac = 0;
   }
 
   void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
@@ -60,6 +66,31 @@ public:
     //pixelNutSupport.msgFormat(F("HueRotate: force=%d pixlen=%d degrees=%d(*100)"), force, pixLength, (int)(addDegrees*100));
   }
 
+  void timedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint16_t msecs)
+  {
+    uint32_t steps = pixelNutSupport.stepsElapsed(handle, pdraw, msecs) + stepFrac;
+    stepFrac = steps & 0xFF; // keep fraction for next time
+    steps >>= 8;
+
+    if (!steps) return; // not enough time for a step
+
+    if (--steps) // advance the hue for the steps beyond this one
+    {
+      if (doResetAtEnd)
+      {
+        pixChanged = (pixChanged + steps) % pixLength;
+        curDegrees = pixChanged * addDegrees;
+      }
+      else
+      {
+        curDegrees = fmod(curDegrees + (steps * addDegrees), MAX_DEGREES_HUE);
+        if (curDegrees < 0) curDegrees += MAX_DEGREES_HUE;
+      }
+    }
+
+    nextstep(handle, pdraw);
+  }
+
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
     //pixelNutSupport.msgFormat(F("HueRotate: degrees=%d"), (int)curDegrees);
@@ -81,7 +112,18 @@ public:
   }
 
 private:
+  void members(PluginState &state)
+  {
+    state.value(doResetAtEnd);
+    state.value(stepFrac);
+    state.value(pixLength);
+    state.value(pixChanged);
+    state.value(addDegrees);
+    state.value(curDegrees);
+  }
+
   bool doResetAtEnd;
+  byte stepFrac;
   uint16_t pixLength, pixChanged;
   float addDegrees, curDegrees;
 };
@@ -1,6 +1,6 @@
 // What Effect Does:
 //
-//    Creates waves in the current color that move down the drawing window, by using a cosine function
+//    Creates waves in the current color that move down the drawing window, by using a cosine wave
 //    that modifies the current brightness level such that it creates the appearance of a light wave.
 //
 //    There are 10 or more steps (pixels) to the wave, determined by the pixel count property: the
@@ -14,6 +14,10 @@
 //
 //    Draws each pixel, scaling the brightness up/down from the current value.
 //
+// Calling timedstep():
+//
+//    Moves the wave by the number of steps the elapsed time corresponds to, then draws it.
+//
 // Properties Used:
 //
 //    r,g,b - the current color values.
@@ -29,37 +33,103 @@ class PNP_LightWave : public PixelNutPlugin
 public:
   byte gettype(void) const
   {
-    return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION;
+    return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION | PLUGIN_TYPE_TIMESTEP;
   };
 
   void begin(byte id, uint16_t pixlen)
   {
     myid = id;
     pixLength = pixlen;
-    angleNext = 0.0; // starting angle
+    phaseNext = 0; // starting angle
+  }
+
+  void timedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint16_t msecs)
+  {
+    uint32_t steps = pixelNutSupport.stepsElapsed(handle, pdraw, msecs);
+    if (steps > 256) // move the wave for the steps beyond this one
+    {
+      // steps to move, less any full waves, where every 10 lengths of them are full waves
+      uint32_t cycle = (uint32_t)pixLength * 10;
+      uint16_t count = WaveCount(pdraw);
+      uint32_t whole = ((steps - 256) >> 8) % cycle;
+      uint32_t moved = ((((whole / pixLength) * (count % 10)) % 10) * pixLength);
+      moved += (((whole % pixLength) * count) % cycle) + (((steps & 0xFF) * count) >> 8);
+      MoveWave(moved % cycle);
+    }
+
+    nextstep(handle, pdraw);
   }
 
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
-    uint16_t count = (pixLength - pdraw->pixCount + 1);
-    float angle_step = (RADIANS_PER_WAVE / 10.0) * ((float)count / pixLength);
-    float angle = angleNext;
+    uint16_t wavecount = WaveCount(pdraw);
+    uint32_t phase_step = WavePhase(wavecount);
+
+    // brightness values scaled from 50-100% by the wave, which is the wave value + 0xFFFF00 times
+    // the maximum brightness divided by BRIGHT_DIV: made with a multiplier that may be one less,
+    // and then corrected, so that they're the same as (0.5 + (cos+1)/4) * max * 255/100 would be
+    byte maxbright = ((PixelNutEngine*)handle)->getMaxBrightness();
+    uint32_t brightmul = ((uint32_t)maxbright << 24) / (BRIGHT_DIV >> 8);
 
-    for (uint16_t i = 0; i < pixLength; ++i, angle += angle_step)
+    // brightness factors for a run of pixels, set going down from the end of the run
+    byte factors[32], count;
+    uint32_t phase = WavePhase(phaseNext) + (phase_step * (pixLength-1));
+
+    for (uint16_t pos = pixLength; pos > 0; pos -= count)
     {
-      float scale = ((cos(angle) + 1.0) / 4.0) + 0.5; // scale from 50-100%
-      pixelNutSupport.setPixel(handle, i, pdraw->r, pdraw->g, pdraw->b, scale);
+      count = ((pos < sizeof(factors)) ? pos : sizeof(factors));
+
+      for (byte i = 0; i < count; ++i, phase -= phase_step)
+      {
+        uint32_t wave = pixelNutSupport.waveValue(phase) + 0xFFFF00;
+        uint32_t bright = ((wave >> 8) * brightmul) >> 24;
+        if (((wave * maxbright) - (bright * BRIGHT_DIV)) >= BRIGHT_DIV) ++bright;
+        factors[i] = pixelNutSupport.gammaCorrect(bright);
+      }
 
-      //pixelNutSupport.msgFormat(F("LightWave: scale=%3d%%, r=%d, g=%d, b=%d"), (int)(scale*100), pdraw->r, pdraw->g, pdraw->b);
+      pixelNutSupport.setPixelRamp(handle, (pos-1), count, pixLength, pdraw->r, pdraw->g, pdraw->b, factors);
     }
-    //pixelNutSupport.msgFormat(F("LightWave: angleNext * 100 = %d"), (int)(angleNext * 100));
+    //pixelNutSupport.msgFormat(F("LightWave: phaseNext=%lu"), phaseNext);
 
-    angleNext -= angle_step; // subtracting causes "forward" motion
-    if (angleNext < 0) angleNext += RADIANS_PER_WAVE;
+    MoveWave(wavecount); // moving backwards causes "forward" motion
   }
 
+  bool intensityonly(void) { return true; } // all pixels redrawn with the current color
+
 private:
+  void members(PluginState &state) { state.value(myid); state.value(pixLength); state.value(phaseNext); }
+
+  // wave value + 0xFFFF00 times the brightness percentage divided by this gives the brightness
+  // value: it's 2 * 0xFFFF00 * MAX_PERCENTAGE / MAX_BYTE_VALUE, or 2 * 257 * 256 * MAX_PERCENTAGE
+  static const uint32_t BRIGHT_DIV = (2UL * 257 * 256 * MAX_PERCENTAGE);
+
   byte myid;
+
+  // returns the number of steps the wave moves from one pixel to the next, where there are
+  // 10 times the number of pixels in a wave, so that there are 10 pixels to the wave when the
+  // pixel count is the full length (and the wave always comes back to where it started)
+  uint16_t WaveCount(PixelNutSupport::DrawProps *pdraw)
+  {
+    return (pixLength - pdraw->pixCount + 1);
+  }
+
+  // moves the wave back by some number of steps (less than a full wave)
+  void MoveWave(uint32_t steps)
+  {
+    phaseNext = ((phaseNext >= steps) ? (phaseNext - steps) : (phaseNext + ((uint32_t)pixLength * 10) - steps));
+  }
+
+  // returns the phase for 'waveValue()' of some number of steps: these aren't wrapped around
+  // down the strip, and a wave of steps is RADIANS_PER_WAVE, which is slightly short of a full
+  // cosine wave (see PHASE_PER_WAVE), so that the wave is just as when drawn with 'cos()'
+  uint32_t WavePhase(uint32_t steps)
+  {
+    uint32_t step = (PHASE_PER_WAVE / 10); // phase of a wave for each pixel
+    uint32_t waves = steps / pixLength;
+    steps -= (waves * pixLength);
+    return (waves * step) + ((step / pixLength) * steps) + (((step % pixLength) * steps) / pixLength);
+  }
+
   uint16_t pixLength;
-  float angleNext;
+  uint32_t phaseNext;   // phase of the first pixel, in steps (less than a wave)
 };
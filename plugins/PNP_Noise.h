@@ -43,17 +43,29 @@ public:
     p.degreeHue = pdraw->degreeHue;
     p.pcentWhite = pdraw->pcentWhite;
 
+    // the colors for each brightness come from the color cache shared by all plugins
+    // (see 'makeColorVals()'), and are then all scaled by the same maximum brightness
+    byte factor = pixelNutSupport.makeBrightFactor(handle, 1.0);
+    byte level = 0, vals[3];
+
     for (uint16_t i = 0; i < pdraw->pixCount; ++i)
     {
       // set random brightness within limits (>= 10%)
-      p.pcentBright = random(10, pdraw->pcentBright+1);
+      p.pcentBright = random(MINBRIGHT, pdraw->pcentBright+1);
       pixelNutSupport.makeColorVals(&p);
+      pixelNutSupport.makePixelVals(p.r, p.g, p.b, &factor, 1, vals);
 
       short pos = random(0, pixLength);
-      pixelNutSupport.setPixel(handle, pos, p.r, p.g, p.b);
+      pixelNutSupport.setPixelVals(handle, pos, 1, &level, vals);
     }
   }
 
+  bool repeatable(void) { return false; } // random pixels are drawn on each step
+
 private:
+  void members(PluginState &state) { state.value(pixLength); }
+
+  enum { MINBRIGHT = 10 }; // minimum brightness percentage
+
   uint16_t pixLength;
 };
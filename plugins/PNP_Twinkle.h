@@ -2,7 +2,9 @@
 //
 //    Scales brightness levels individually up and down to create a twinkle effect.
 //    The number of pixels affected is determined by the pixel count property.
-//    Allocates 2 bytes of memory per number of pixels.
+//    Allocates 2 bytes of memory per number of pixels: a counter and a brightness level.
+//    PNP_TwinkleStatic<PIXELS> (below) has that memory in the plugin object itself instead,
+//    for up to PIXELS pixels, so that it can be used without a heap (see 'PixelNutStatic.h').
 //
 // Calling trigger():
 //
@@ -26,7 +28,8 @@
 class PNP_Twinkle : public PixelNutPlugin
 {
 public:
-  ~PNP_Twinkle() { if (pbytes != NULL) free(pbytes); }
+  PNP_Twinkle() : pcounts(NULL), pMemory(NULL), maxPixels(0) {}
+  ~PNP_Twinkle() { if ((pcounts != NULL) && (pcounts != pMemory)) free(pcounts); }
 
   byte gettype(void) const
   {
@@ -36,86 +39,173 @@ public:
   void begin(byte id, uint16_t pixlen)
   {
     pixLength = pixlen;
-    pbytes = (int16_t*)malloc(pixLength * sizeof(int16_t));
+    pcounts = AllocCounts(pixLength); // levels follow the counters
 
-    maxvalue = 50;
+    randSeed = 1;
+    makeVals = true;
 
-    if (pbytes != NULL)
+    if (pcounts != NULL)
+    {
+      plevels = (byte*)(pcounts + pixLength);
+      memset(plevels, 0, pixLength);
+
+      // the dark times are seeded from the starting counts, so that random() is
+      // only called for those, as it always has been
       for (uint16_t i = 0; i < pixLength; ++i)
-        pbytes[i] = random(0, ((maxvalue * 2) + maxvalue)) - maxvalue;
+      {
+        pcounts[i] = random(0, ((MAXVALUE * 2) + MAXVALUE)) - MAXVALUE;
+        randSeed = (randSeed * 33) + (byte)pcounts[i];
+      }
+      if (randSeed == 0) randSeed = 1; // xorshift must never be zero
+    }
   }
 
+  uint16_t memsize(uint16_t pixlen) { return ((pixlen <= maxPixels) ? 0 : (pixlen * 2)); }
+
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
-    if (pbytes == NULL) return;
-    
-    int draw = 0, skip = 0;
+    if (pcounts == NULL) return;
 
-    for (uint16_t i = 0; i < pixLength; ++i)
+    // intensities for each level only change with the maximum brightness
+    // (only intensities are drawn: the color is applied when the track is shown)
+    byte maxbright = ((PixelNutEngine*)handle)->getMaxBrightness();
+    if (makeVals || (valsBright != maxbright))
     {
-      if (!draw && !skip)
-      {
-        if (pdraw->pixCount == 1)
-        {
-          skip = 0;
-          draw = pixLength;
-        }
-        else if (pdraw->pixCount == pixLength)
-        {
-          skip = pixLength;
-          draw = 0;
-        }
-        else if (pdraw->pixCount > (pixLength - pdraw->pixCount))
-        {
-          skip = pdraw->pixCount / (pixLength - pdraw->pixCount);
-          draw = 1;
-        }
-        else
-        {
-          draw = (pixLength - pdraw->pixCount) / pdraw->pixCount;
-          skip = 1;
-        }
-
-        //pixelNutSupport.msgFormat(F("Twinkle: draw=%d skip=%d"), draw, skip);
-      }
+      for (byte i = 0; i < MAXVALUE; ++i)
+        pixVals[i] = pixelNutSupport.makeBrightFactor(handle, ((float)i / MAXVALUE));
 
-      float scale = 0.0;
+      valsBright = maxbright;
+      makeVals = false;
+    }
 
-      if (draw)
-      {
-        --draw;
-        //pixelNutSupport.msgFormat(F("Twinkle: pbytes[%d]=%d"), i, pbytes[i]);
-
-        bool doscale = true;
-
-        if (pbytes[i] >= maxvalue)
-        {
-          if (--(pbytes[i]) >= maxvalue)
-            continue; // keep off for now
-
-          pbytes[i] = 1; // draw now, increasing level
-        }
-        else if (++(pbytes[i]) == 0)
-        {
-          pbytes[i] = maxvalue + random(10, 60); // go dark for random time
-          doscale = false;
-        }
-        else if (pbytes[i] == maxvalue)
-          pbytes[i] = -(maxvalue-1); // start decreasing level
-
-        if (doscale) scale = ((float)abs(pbytes[i])) / maxvalue;
-      }
-      else
+    uint16_t draw, skip; // number of pixels drawn, then skipped, in each block
+
+    if (pdraw->pixCount == 1)
+    {
+      skip = 0;
+      draw = pixLength;
+    }
+    else if (pdraw->pixCount >= pixLength)
+    {
+      skip = pixLength;
+      draw = 0;
+    }
+    else if (pdraw->pixCount > (pixLength - pdraw->pixCount))
+    {
+      skip = pdraw->pixCount / (pixLength - pdraw->pixCount);
+      draw = 1;
+    }
+    else
+    {
+      draw = (pixLength - pdraw->pixCount) / pdraw->pixCount;
+      skip = 1;
+    }
+
+    //pixelNutSupport.msgFormat(F("Twinkle: draw=%d skip=%d"), draw, skip);
+
+    int8_t *pc = pcounts;
+    byte *pl = plevels;
+
+    for (uint16_t left = pixLength; left > 0; )
+    {
+      uint16_t count = ((draw < left) ? draw : left);
+      left -= count;
+
+      for (; count > 0; --count, ++pc, ++pl)
       {
-        --skip;
-        //pixelNutSupport.msgFormat(F("Twinkle: skipping #%d"), i);
+        int8_t val = *pc;
+
+        if (val >= MAXVALUE) // keep off for now, then draw with increasing level
+             val = ((val == MAXVALUE) ? 1 : (val - 1));
+        else if (++val == 0)
+             val = MAXVALUE + RandDelay(); // go dark for random time
+        else if (val == MAXVALUE)
+             val = -(MAXVALUE-1); // start decreasing level
+
+        *pc = val;
+        *pl = ((val >= MAXVALUE) ? 0 : ((val < 0) ? -val : val));
       }
 
-      pixelNutSupport.setPixel(handle, i, pdraw->r, pdraw->g, pdraw->b, scale);
+      count = ((skip < left) ? skip : left);
+      left -= count;
+
+      memset(pl, 0, count); // skipped pixels are dark
+      pc += count;
+      pl += count;
     }
+
+    pixelNutSupport.setPixelVals(handle, 0, pixLength, plevels, pixVals);
   }
 
+  uint16_t savestate(byte *pbuff)
+  {
+    if (pcounts == NULL) return 0;
+
+    uint16_t len = pixLength * 2;
+    if (pbuff != NULL)
+    {
+      memcpy(pbuff, pcounts, len);
+      memcpy((pbuff + len), &randSeed, sizeof(randSeed));
+    }
+    return (len + sizeof(randSeed));
+  }
+
+  bool loadstate(byte id, uint16_t pixlen, const byte *pbuff, uint16_t len)
+  {
+    if (len != ((pixlen * 2) + sizeof(randSeed))) return false;
+
+    pcounts = AllocCounts(pixlen);
+    if (pcounts == NULL) return false;
+
+    memcpy(pcounts, pbuff, (pixlen * 2));
+    memcpy(&randSeed, (pbuff + (pixlen * 2)), sizeof(randSeed));
+
+    pixLength = pixlen;
+    plevels = (byte*)(pcounts + pixLength);
+    makeVals = true;
+    return true;
+  }
+
+  bool intensityonly(void) { return true; } // all pixels redrawn with the current color
+
+protected:
+  // uses 'pmemory' (2 bytes for each of up to 'maxpixels' pixels) instead of allocating it
+  PNP_Twinkle(int8_t *pmemory, uint16_t maxpixels) : pcounts(NULL), pMemory(pmemory), maxPixels(maxpixels) {}
+
 private:
+  enum { MAXVALUE = 50 }; // number of brightness levels
+
+  int8_t *AllocCounts(uint16_t pixlen)
+  {
+    if (pixlen <= maxPixels) return pMemory;
+    return (int8_t*)malloc(pixlen * 2);
+  }
+
+  // returns a random dark time of 10-59 steps, drawn each time a pixel goes dark (xorshift)
+  byte RandDelay(void)
+  {
+    randSeed ^= randSeed << 13;
+    randSeed ^= randSeed >> 17;
+    randSeed ^= randSeed << 5;
+    return 10 + (((randSeed >> 24) * 50) >> 8);
+  }
+
   uint16_t pixLength;
-  int16_t *pbytes, maxvalue;
+  int8_t *pcounts;                  // counts up through levels, or down while dark, for each pixel
+  byte *plevels;                    // brightness level to draw for each pixel
+  uint32_t randSeed;
+  bool makeVals;                    // true to remake the intensities for each level
+  byte valsBright;
+  byte pixVals[MAXVALUE];           // intensity for each level
+  int8_t *pMemory;                  // memory used for the above if not allocated (or NULL)
+  uint16_t maxPixels;               // max pixels that memory has room for
+};
+
+template <uint16_t PIXELS> class PNP_TwinkleStatic : public PNP_Twinkle
+{
+public:
+  PNP_TwinkleStatic() : PNP_Twinkle(memory, PIXELS) {}
+
+private:
+  int8_t memory[PIXELS * 2];
 };
@@ -87,6 +87,16 @@ public:
   }
 
 private:
+  void members(PluginState &state)
+  {
+    state.value(myid);
+    state.value(forceVal);
+    state.value(goForward);
+    state.value(pixCenter);
+    state.value(headPos);
+    state.value(tailPos);
+  }
+
   byte myid;
   short forceVal;
   bool goForward;
@@ -11,11 +11,16 @@
 // Routines for drawing comets effects:
 // Create: assigns data space to hold requested heads, returns NULL if failed
 // Delete: must be called by plugin destructor to clean up any memory allocated
-// Add: creates new head, or overwrites old one if already reached the maximum
+// Add: creates new head at the start, unless already reached the maximum, which takes
+//      constant time no matter how many heads there are (they're kept in position order)
 //      ('dowrap' controls whether or not comet wraps around, or falls off end)
 // Draw: draws all heads given draw settings, returns true if anything drawn
 //       (length of comet is controlled by "pixCount" parameter in DrawProps)
 // Both Draw/Add return the number of heads currently in use
+// Save: copies all head data into buffer (if not NULL), returns the number of bytes it takes
+// Load: creates heads from data previously saved, returns NULL if failed
+// Bytes: returns the memory used by Create and Draw for that many heads and pixels
+// Count: returns the number of heads there's space for (that Create or Load made), 0 if NULL
 
 class PixelNutComets
 {
@@ -26,6 +31,10 @@ public:
     int cometHeadAdd(cometData cdata, byte layer, bool dowrap, uint16_t pixlen);
     int cometHeadDraw(cometData cdata, byte layer,
           PixelNutSupport::DrawProps *pdraw, PixelNutHandle handle, uint16_t pixlen);
+    uint16_t cometHeadSave(cometData cdata, byte *pbuff);
+    cometData cometHeadLoad(const byte *pbuff, uint16_t len);
+    uint16_t cometHeadBytes(uint16_t headcount, uint16_t pixlen);
+    uint16_t cometHeadCount(cometData cdata);
 };
 
 extern PixelNutComets pixelNutComets; // single statically allocated object instance